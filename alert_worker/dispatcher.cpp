@@ -0,0 +1,316 @@
+#include "dispatcher.h"
+#include "../shared/log.h"
+#include "../third_party/httplib.h"
+#include "../third_party/nlohmann/json.hpp"
+#include <algorithm>
+#include <ctime>
+#include <random>
+
+using json = nlohmann::json;
+
+static const char* SENT_HELP = "Alert delivery attempts by result";
+
+AlertDispatcher::AlertDispatcher(Database& db, const Options& opts)
+    : db_(db),
+      opts_(opts),
+      batch_supported_(opts.batch > 1),
+      send_latency_(Metrics::instance().histogram("alert_send_duration_seconds", "One /alert_notify round trip")),
+      delivery_delay_(Metrics::instance().histogram("alert_delivery_delay_seconds",
+                                                    "Time from create_alert to an acknowledged delivery", "",
+                                                    {0.5, 1, 2, 5, 10, 30, 60, 120, 300, 600})),
+      sent_ok_(Metrics::instance().counter("alerts_sent_total", SENT_HELP, "result=\"ok\"")),
+      sent_failed_(Metrics::instance().counter("alerts_sent_total", SENT_HELP, "result=\"failed\"")),
+      gave_up_(Metrics::instance().counter("alerts_sent_total", SENT_HELP, "result=\"gave_up\""))
+{
+    opts_.concurrency = std::max(1, opts_.concurrency);
+    opts_.batch = std::max<size_t>(1, opts_.batch);
+    Metrics::instance().gauge_fn("alerts_queued", "Alerts waiting in the dispatcher or in flight",
+                                 [this] { return static_cast<double>(queued()); });
+}
+
+AlertDispatcher::~AlertDispatcher()
+{
+    stop();
+}
+
+void AlertDispatcher::start()
+{
+    for (int i = 0; i < opts_.concurrency; ++i)
+        workers_.emplace_back(&AlertDispatcher::worker_loop, this);
+    Logger::instance().info("Alert dispatcher: " + std::to_string(opts_.concurrency) + " workers, batch " +
+                            std::to_string(opts_.batch));
+}
+
+void AlertDispatcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_)
+        t.join();
+    workers_.clear();
+
+    // Hand back what is still queued so another worker need not wait for
+    // the leases to run out.
+    std::vector<int> unsent;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto& kv : queues_) {
+            for (const auto& a : kv.second)
+                unsent.push_back(a.id);
+        }
+        queues_.clear();
+        ready_.clear();
+        known_.clear();
+    }
+    if (!unsent.empty())
+        db_.release_alerts(opts_.worker_id, unsent);
+}
+
+size_t AlertDispatcher::queued() const
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    return known_.size();
+}
+
+bool AlertDispatcher::poll(int max)
+{
+    // Claim no more than about two rounds of work: leases held in our queue
+    // are alerts other workers cannot send.
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        size_t room = static_cast<size_t>(opts_.concurrency) * opts_.batch * 2;
+        room = room > known_.size() ? room - known_.size() : 0;
+        max = static_cast<int>(std::min<size_t>(static_cast<size_t>(std::max(0, max)), room));
+    }
+    if (max <= 0)
+        return false;   // full: look again once workers have made room
+    std::vector<AlertRow> alerts = db_.claim_alerts(opts_.worker_id, max, opts_.lease_secs);
+
+    size_t added = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto& a : alerts) {
+            // Ours already: a lease that ran out while queued, claimed again.
+            if (!known_.insert(a.id).second)
+                continue;
+            auto& q = queues_[a.sensor_uuid];
+            if (q.empty() && !busy_.count(a.sensor_uuid))
+                ready_.push_back(a.sensor_uuid);
+            q.push_back(a);
+            ++added;
+        }
+    }
+    if (added)
+        cv_.notify_all();
+    return alerts.size() < static_cast<size_t>(max);
+}
+
+// Takes whole sensor queues (up to the batch size) from sensors with nothing
+// in flight, and marks them busy.
+std::vector<AlertRow> AlertDispatcher::next_batch()
+{
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [this] { return stop_ || !ready_.empty(); });
+
+    std::vector<AlertRow> batch;
+    if (stop_)
+        return batch;
+    while (!ready_.empty() && batch.size() < opts_.batch) {
+        std::string uuid = std::move(ready_.front());
+        ready_.pop_front();
+        auto& q = queues_[uuid];
+        busy_.insert(uuid);
+        while (!q.empty() && batch.size() < opts_.batch) {
+            batch.push_back(std::move(q.front()));
+            q.pop_front();
+        }
+    }
+    return batch;
+}
+
+static std::string describe(const httplib::Result& res)
+{
+    if (!res)
+        return "request failed: " + httplib::to_string(res.error());
+    return "HTTP " + std::to_string(res->status);
+}
+
+AlertDispatcher::Result AlertDispatcher::deliver(httplib::Client& cli, const std::vector<AlertRow>& batch)
+{
+    Result r;
+
+    if (batch_supported_.load()) {
+        json arr = json::array();
+        for (const auto& a : batch)
+            arr.push_back({{"id", a.id}, {"key", a.idem_key}, {"uuid", a.sensor_uuid},
+                           {"temp", a.temperature}, {"vib", a.vibration},
+                           {"count", a.count}, {"peak_temp", a.peak_temp}, {"peak_vib", a.peak_vib}});
+
+        ScopedTimer t(send_latency_);
+        auto res = cli.Post("/alert_notify/batch", arr.dump(), "application/json");
+        if (res && res->status == 404) {
+            Logger::instance().warn("Gateway has no /alert_notify/batch, sending one by one");
+            batch_supported_.store(false);
+        } else {
+            for (const auto& a : batch)
+                r.attempted.insert(a.id);
+            if (res && res->status == 200) {
+                try {
+                    json reply = json::parse(res->body);
+                    for (const auto& id : reply.at("acked"))
+                        r.acked.insert(id.get<int>());
+                    r.error = "not acknowledged";
+                } catch (...) {
+                    Logger::instance().warn("Malformed batch ack from gateway");
+                    r.error = "malformed ack";
+                }
+            } else {
+                r.error = describe(res);
+            }
+            return r;
+        }
+    }
+
+    // One by one; after a failure, later alerts of the same sensor are not
+    // sent so they can't overtake it.
+    std::unordered_set<std::string> failed;
+    for (const auto& a : batch) {
+        if (failed.count(a.sensor_uuid))
+            continue;
+        std::string msg = "ALERT " + a.sensor_uuid + " TEMP=" + std::to_string(a.temperature) +
+                          " VIB=" + std::to_string(a.vibration) + " COUNT=" + std::to_string(a.count);
+        Logger::instance().info("Sending: " + msg);
+
+        ScopedTimer t(send_latency_);
+        httplib::Headers headers = {{"Idempotency-Key", a.idem_key}};
+        auto res = cli.Post("/alert_notify", headers, msg, "text/plain");
+        r.attempted.insert(a.id);
+        if (res && res->status == 200) {
+            r.acked.insert(a.id);
+        } else {
+            failed.insert(a.sensor_uuid);
+            r.error = describe(res);
+        }
+    }
+    return r;
+}
+
+// Equal jitter: half the exponential delay is kept, so retries never pile
+// up right after a failure, and the other half is random, so alerts that
+// failed together (gateway down) do not all come back in the same second.
+int AlertDispatcher::backoff_secs(int attempts) const
+{
+    int64_t delay = std::max(1, opts_.retry_base_secs);
+    for (int i = 0; i < attempts && delay < opts_.retry_max_secs; ++i)
+        delay *= 2;
+    delay = std::min<int64_t>(delay, std::max(1, opts_.retry_max_secs));
+
+    thread_local std::mt19937 rng(std::random_device{}());
+    std::uniform_int_distribution<int64_t> jitter(0, delay / 2);
+    return static_cast<int>(delay - delay / 2 + jitter(rng));
+}
+
+void AlertDispatcher::apply(const std::vector<AlertRow>& batch, const Result& r)
+{
+    // Decide everything first; the write lock is then held only for the
+    // few statements of apply_alert_results.
+    const int now = static_cast<int>(time(nullptr));
+    AlertResults out;
+    out.reason = "max_retry";
+    out.last_error = r.error;
+    for (const auto& a : batch) {
+        if (!r.attempted.count(a.id))
+            continue;
+        if (r.acked.count(a.id)) {
+            sent_ok_.inc();
+            if (a.created_at > 0)
+                delivery_delay_.observe(std::max(0, now - a.created_at));
+            out.delivered.push_back(a.id);
+        } else {
+            sent_failed_.inc();
+            if (a.attempts + 1 >= opts_.max_retry) {
+                Logger::instance().error("Max retry reached — dead-lettering alert " + std::to_string(a.id) +
+                                         " (" + r.error + ")");
+                gave_up_.inc();
+                out.dead.push_back(a.id);
+                continue;
+            }
+            int due = now + backoff_secs(a.attempts);
+            Logger::instance().warn("Alert " + std::to_string(a.id) + " failed — retry in " +
+                                    std::to_string(due - now) + "s");
+            out.retry.emplace_back(a.id, due);
+        }
+    }
+    if (out.delivered.empty() && out.retry.empty() && out.dead.empty())
+        return;
+    if (!db_.apply_alert_results(out))
+        return;   // leases run out and the alerts are claimed again
+
+    if (opts_.on_retry) {
+        for (const auto& rt : out.retry)
+            opts_.on_retry(rt.first, rt.second);
+    }
+}
+
+// Hands the batch's sensors back: ready again if more alerts are queued,
+// or reset to the DB's view (next poll) if one of them failed.
+void AlertDispatcher::release(const std::vector<AlertRow>& batch, const Result& r)
+{
+    // Claimed but never sent: give the leases back so the sensor is not
+    // held up until they expire.
+    std::vector<int> unsent;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::unordered_set<std::string> failed;
+        for (const auto& a : batch) {
+            known_.erase(a.id);
+            if (!r.acked.count(a.id))
+                failed.insert(a.sensor_uuid);
+            if (!r.attempted.count(a.id))
+                unsent.push_back(a.id);
+        }
+        for (const auto& a : batch) {
+            if (!busy_.erase(a.sensor_uuid))
+                continue;   // sensor already handled
+            auto it = queues_.find(a.sensor_uuid);
+            if (it == queues_.end())
+                continue;
+            if (failed.count(a.sensor_uuid)) {
+                for (const auto& rest : it->second) {
+                    known_.erase(rest.id);
+                    unsent.push_back(rest.id);
+                }
+                it->second.clear();
+            }
+            if (it->second.empty())
+                queues_.erase(it);
+            else
+                ready_.push_back(a.sensor_uuid);
+        }
+    }
+    cv_.notify_all();
+    if (!unsent.empty())
+        db_.release_alerts(opts_.worker_id, unsent);
+}
+
+void AlertDispatcher::worker_loop()
+{
+    // httplib::Client isn't thread-safe: one keep-alive connection per worker.
+    httplib::Client cli(opts_.host, opts_.port);
+    cli.set_keep_alive(true);
+    cli.set_connection_timeout(2);
+    cli.set_read_timeout(5);
+
+    while (true) {
+        std::vector<AlertRow> batch = next_batch();
+        if (batch.empty())
+            return;   // stopping
+
+        Result r = deliver(cli, batch);
+        apply(batch, r);
+        release(batch, r);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../shared/db.h"
+#include "../shared/metrics.h"
+
+namespace httplib { class Client; }
+
+// Delivers alerts to the gateway from a fixed pool of workers, each with
+// its own keep-alive connection, so one slow request holds up one worker
+// instead of the whole queue.
+//
+// Ordering: a sensor has at most one request in flight. Its queued alerts
+// go out in id order, and when one fails the rest of that sensor's queue
+// is dropped, to be picked up again (failed one first) by the next poll.
+//
+// Scale-out: alerts are claimed with a lease (Database::claim_alerts), so
+// several alert_worker processes can share the table. Alerts left unsent
+// (dropped queues, stop()) are released; a crashed worker's leases simply
+// run out. A lease that expires mid-delivery can lead to a second
+// delivery, which the gateway drops by idempotency key.
+//
+// Retries: a failed alert is not due again until next_attempt_at, set to
+// an exponential backoff with jitter, and get_pending_alerts holds back
+// the sensor's later alerts until then. After max_retry attempts the
+// alert moves to the dead-letter table (Database::dead_letter_alert).
+class AlertDispatcher {
+public:
+    struct Options {
+        std::string host = "sensor_gateway";
+        int port = 9002;
+        std::string worker_id;    // claimed_by; unique per process
+        int lease_secs = 60;      // claim lease, well above a delivery's timeouts
+        int concurrency = 8;      // workers = requests in flight
+        size_t batch = 50;        // alerts per /alert_notify/batch request
+        int max_retry = 5;        // attempts before an alert is closed
+        int retry_base_secs = 2;  // backoff after the first failure, doubling
+        int retry_max_secs = 300; // backoff cap
+        // Called after a failed alert's next_attempt_at has been committed,
+        // from a worker thread.
+        std::function<void(int id, int64_t due)> on_retry;
+    };
+
+    AlertDispatcher(Database& db, const Options& opts);
+    ~AlertDispatcher();
+
+    void start();
+    void stop();
+
+    // Claims up to `max` due alerts (fewer if the queue is already full)
+    // and queues them. Returns false if more may be waiting (it took all
+    // it asked for, or had no room), so the caller should poll again soon.
+    bool poll(int max);
+
+    size_t queued() const;
+
+private:
+    struct Result {
+        std::unordered_set<int> acked;
+        std::unordered_set<int> attempted;   // sent, whether acked or not
+        std::string error;                   // last failure, for dead letters
+    };
+
+    void worker_loop();
+    std::vector<AlertRow> next_batch();
+    Result deliver(httplib::Client& cli, const std::vector<AlertRow>& batch);
+    void apply(const std::vector<AlertRow>& batch, const Result& r);
+    void release(const std::vector<AlertRow>& batch, const Result& r);
+    int backoff_secs(int attempts) const;
+
+    Database& db_;
+    Options opts_;
+    std::atomic<bool> batch_supported_;
+
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::unordered_map<std::string, std::deque<AlertRow>> queues_;
+    std::deque<std::string> ready_;          // queued alerts, nothing in flight
+    std::unordered_set<std::string> busy_;   // a request is in flight
+    std::unordered_set<int> known_;          // ids queued or in flight
+    size_t queued_ = 0;
+    std::vector<std::thread> workers_;
+
+    Histogram& send_latency_;
+    Histogram& delivery_delay_;
+    Counter& sent_ok_;
+    Counter& sent_failed_;
+    Counter& gave_up_;
+};
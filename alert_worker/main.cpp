@@ -2,10 +2,19 @@
 #include <thread>
 #include <cstdlib>   // for std::getenv
 #include <string>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unistd.h>
 #include "../shared/log.h"
 #include "../shared/models.h"
 #include "../shared/db.h"
 #include "../third_party/httplib.h"
+#include "../shared/metrics.h"
+#include "../shared/http_metrics.h"
+#include "../shared/alert_wake.h"
+#include "dispatcher.h"
+#include "timer_wheel.h"
 
 using namespace std;
 
@@ -19,44 +28,146 @@ static std::string get_db_path() {
     return "/app/data/iot.db";
 }
 
+static std::string get_gateway_host() {
+    if (const char* env = std::getenv("GATEWAY_HOST")) {
+        if (*env) return std::string(env);
+    }
+    return "sensor_gateway";
+}
+
+// Alerts per POST /alert_notify/batch (1 = one request per alert)
+static int get_notify_batch() {
+    if (const char* env = std::getenv("NOTIFY_BATCH")) {
+        if (*env) return std::max(1, std::atoi(env));
+    }
+    return 50;
+}
+
+// The worker has no API of its own; /metrics is served on a side port.
+static int get_metrics_port() {
+    if (const char* env = std::getenv("METRICS_PORT")) {
+        if (*env) return std::atoi(env);
+    }
+    return 9003;
+}
+
+// Fallback poll while waiting for wake-ups (retries, missed signals)
+static int get_poll_secs() {
+    if (const char* env = std::getenv("ALERT_POLL_SECS")) {
+        if (*env) return std::max(1, std::atoi(env));
+    }
+    return 10;
+}
+
+// Retry backoff: base doubles per failed attempt up to the cap, plus jitter
+static int get_retry_base_secs() {
+    if (const char* env = std::getenv("RETRY_BASE_SECS")) {
+        if (*env) return std::max(1, std::atoi(env));
+    }
+    return 2;
+}
+
+static int get_retry_max_secs() {
+    if (const char* env = std::getenv("RETRY_MAX_SECS")) {
+        if (*env) return std::max(1, std::atoi(env));
+    }
+    return 300;
+}
+
+// claimed_by for this process; must differ between workers sharing the DB
+static std::string get_worker_id() {
+    if (const char* env = std::getenv("WORKER_ID")) {
+        if (*env) return std::string(env);
+    }
+    char host[256] = {0};
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host) + ":" + std::to_string(getpid());
+}
+
+// How long a claimed alert stays ours before another worker may take it
+static int get_lease_secs() {
+    if (const char* env = std::getenv("ALERT_LEASE_SECS")) {
+        if (*env) return std::max(10, std::atoi(env));
+    }
+    return 60;
+}
+
+static int64_t now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Requests in flight at once (one worker and connection each)
+static int get_dispatch_concurrency() {
+    if (const char* env = std::getenv("DISPATCH_CONCURRENCY")) {
+        if (*env) return std::max(1, std::atoi(env));
+    }
+    return 8;
+}
+
 int main() {
     Logger::instance().info("=== ALERT WORKER STARTED ===");
 
     Database db(get_db_path());
 
+    Metrics::instance().gauge_fn("alerts_pending", "Alerts not yet delivered or given up on",
+                                 [&db] { return static_cast<double>(db.count_pending_alerts()); });
+
+    httplib::Server metrics_svr;
+    http_metrics::install(metrics_svr);
+    int metrics_port = get_metrics_port();
+    std::thread metrics_thread;
+    if (metrics_port > 0) {
+        metrics_thread = std::thread([&metrics_svr, metrics_port] {
+            Logger::instance().info("Metrics on 0.0.0.0:" + std::to_string(metrics_port));
+            metrics_svr.listen("0.0.0.0", metrics_port);
+        });
+    }
+
+    // The gateway signals as soon as it commits alerts; without the socket
+    // we fall back to the old 2s poll. One socket per worker, so every
+    // worker of a scaled-out fleet is woken.
+    const std::string worker_id = get_worker_id();
+    AlertWakeReceiver wake(alert_wake_dir(get_db_path()), worker_id);
+    const int poll_ms = (wake.ok() ? get_poll_secs() : 2) * 1000;
+
+    // Scheduled retries, so the loop sleeps until the next one is due.
+    // Only a wake-up hint: the DB decides what is due, and after a restart
+    // the fallback poll picks up retries scheduled by the previous run.
+    std::mutex retry_mtx;
+    TimerWheel retries(now_ms() / 1000);
+
+    AlertDispatcher::Options opts;
+    opts.host = get_gateway_host();
+    opts.worker_id = worker_id;
+    opts.lease_secs = get_lease_secs();
+    opts.concurrency = get_dispatch_concurrency();
+    opts.batch = static_cast<size_t>(get_notify_batch());
+    opts.max_retry = MAX_RETRY;
+    opts.retry_base_secs = get_retry_base_secs();
+    opts.retry_max_secs = get_retry_max_secs();
+    opts.on_retry = [&](int id, int64_t due) {
+        {
+            std::lock_guard<std::mutex> lock(retry_mtx);
+            retries.schedule(id, due);
+        }
+        wake.kick();   // the loop may be sleeping past `due`
+    };
+    AlertDispatcher dispatcher(db, opts);
+    dispatcher.start();
+
+    // Anything already queued or in flight is skipped by poll(), so a
+    // slow delivery is never sent twice.
     while (true) {
-        auto alerts = db.get_pending_alerts(100);
-
-        db.exec("BEGIN;");
-        for (auto &a : alerts) {
-            string uuid = a.sensor_uuid;
-            double t = a.temperature;
-            double vib = a.vibration;
-            int attempts = a.attempts;
-
-            string msg = "ALERT " + uuid + " TEMP=" + to_string(t) + " VIB=" + to_string(vib);
-
-            Logger::instance().info("Sending: " + msg);
-
-            httplib::Client cli("sensor_gateway", 9002);
-            auto res = cli.Post("/alert_notify", msg, "text/plain");
-
-            if (res && res->status == 200) {
-                Logger::instance().info("Alert ACK — processing OK");
-                db.mark_alert_processed(a.id);
-            }
-            else {
-                Logger::instance().warn("Alert failed — retry ++");
-                db.mark_alert_failed(a.id);
-
-                if (attempts + 1 >= MAX_RETRY) {
-                    Logger::instance().error("Max retry reached — closing alert");
-                    db.mark_alert_done(a.id);
-                }
-            }
+        int timeout_ms = dispatcher.poll(100) ? poll_ms : 100;
+        {
+            std::lock_guard<std::mutex> lock(retry_mtx);
+            int64_t now = now_ms();
+            retries.advance(now / 1000);
+            if (int64_t due = retries.next_due())
+                timeout_ms = static_cast<int>(std::clamp<int64_t>(due * 1000 - now, 0, timeout_ms));
         }
-        db.exec("COMMIT;");
-        this_thread::sleep_for(chrono::seconds(2));
+        wake.wait(timeout_ms);
     }
     return 0;
 }
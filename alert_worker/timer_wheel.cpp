@@ -0,0 +1,93 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(int64_t now) : now_(now)
+{
+}
+
+void TimerWheel::schedule(int id, int64_t due)
+{
+    place(Timer{id, due});
+    size_++;
+}
+
+void TimerWheel::place(const Timer& t)
+{
+    int64_t delta = t.due - now_;
+    if (delta <= 0) {
+        overdue_.push_back(t);
+        return;
+    }
+
+    // The lowest level whose span still reaches `due`; slots are indexed by
+    // absolute time so a timer's slot does not depend on when it was placed.
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (int64_t(1) << (BITS * (level + 1))))
+        level++;
+    int64_t at = level == LEVELS - 1
+                     ? std::min(t.due, now_ + (int64_t(1) << (BITS * LEVELS)) - 1)
+                     : t.due;
+    slots_[level][(at >> (BITS * level)) & (SLOTS - 1)].push_back(t);
+}
+
+std::vector<int> TimerWheel::advance(int64_t now)
+{
+    std::vector<int> fired;
+    for (const auto& t : overdue_)
+        fired.push_back(t.id);
+    overdue_.clear();
+
+    while (now_ < now) {
+        now_++;
+
+        // Entering a new span at level l: re-place that span's timers one
+        // level down (or further, they go wherever they now belong).
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((now_ & ((int64_t(1) << (BITS * level)) - 1)) != 0)
+                break;
+            auto& slot = slots_[level][(now_ >> (BITS * level)) & (SLOTS - 1)];
+            std::vector<Timer> moving;
+            moving.swap(slot);
+            for (const auto& t : moving)
+                place(t);
+        }
+
+        auto& slot = slots_[0][now_ & (SLOTS - 1)];
+        for (const auto& t : slot)
+            fired.push_back(t.id);
+        slot.clear();
+        for (const auto& t : overdue_)
+            fired.push_back(t.id);
+        overdue_.clear();
+    }
+
+    size_ -= fired.size();
+    return fired;
+}
+
+int64_t TimerWheel::next_due() const
+{
+    if (size_ == 0)
+        return 0;
+    if (!overdue_.empty())
+        return now_;
+
+    // Within a level, the first non-empty slot after the cursor holds that
+    // level's earliest timers (the cursor's own slot can only hold ones a
+    // full turn ahead). Levels overlap in time, so take the minimum.
+    int64_t best = 0;
+    for (int level = 0; level < LEVELS; ++level) {
+        int64_t cursor = now_ >> (BITS * level);
+        for (int i = 1; i <= SLOTS; ++i) {
+            const auto& slot = slots_[level][(cursor + i) & (SLOTS - 1)];
+            if (slot.empty())
+                continue;
+            for (const auto& t : slot) {
+                if (best == 0 || t.due < best)
+                    best = t.due;
+            }
+            break;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timing wheel with one-second ticks: level 0 holds the next
+// 64 seconds, each level above covers 64 times the span of the one below
+// (about 194 days at 4 levels; anything further out waits in the top
+// level and is re-placed as it nears). schedule() and each tick of
+// advance() are O(1) amortised; timers cascade down a level as their
+// slot comes round.
+class TimerWheel {
+public:
+    explicit TimerWheel(int64_t now);
+
+    // Fires `id` at `due` (unix seconds); a due already past fires on the
+    // next advance().
+    void schedule(int id, int64_t due);
+
+    // Moves the wheel to `now` and returns the ids whose time has come.
+    std::vector<int> advance(int64_t now);
+
+    // Earliest due among the scheduled timers, 0 if there are none.
+    int64_t next_due() const;
+
+    size_t size() const { return size_; }
+
+private:
+    static const int BITS = 6;
+    static const int SLOTS = 1 << BITS;
+    static const int LEVELS = 4;
+
+    struct Timer {
+        int id;
+        int64_t due;
+    };
+
+    void place(const Timer& t);
+
+    std::vector<Timer> slots_[LEVELS][SLOTS];
+    std::vector<Timer> overdue_;
+    int64_t now_;
+    size_t size_ = 0;
+};
@@ -1,18 +1,22 @@
 #include <iostream>
 #include <cstdlib>   // for std::getenv
 #include <string>
+#include <algorithm>
 #include "../shared/db.h"
 #include "../shared/models.h"
 #include "../shared/log.h"
 #include "../third_party/httplib.h"
+#include "../shared/http_metrics.h"
+#include "../shared/http_paging.h"
 #include "../third_party/nlohmann/json.hpp"
 
 using json = nlohmann::json;
 
 static void add_cors(httplib::Response& res) {
     res.set_header("Access-Control-Allow-Origin", "*");
-    res.set_header("Access-Control-Allow-Headers", "Content-Type");
+    res.set_header("Access-Control-Allow-Headers", "Content-Type, If-None-Match");
     res.set_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+    res.set_header("Access-Control-Expose-Headers", "ETag, X-Next-After-Id");
 }
 
 static std::string get_db_path() {
@@ -23,12 +27,24 @@ static std::string get_db_path() {
     return "/app/data/iot.db";
 }
 
+// Read-only connections in the DB pool (0 = single shared connection)
+static int get_db_readers() {
+    if (const char* env = std::getenv("DB_READERS")) {
+        if (*env) return std::max(0, std::atoi(env));
+    }
+    return 2;
+}
+
 int main() {
     Logger::instance().info("=== AUTH SERVICE STARTED ===");
 
-    Database db(get_db_path());
+    Database db(get_db_path(), get_db_readers());
     httplib::Server svr;
 
+    // ---------- METRICS ----------
+    // GET /metrics; times every route below
+    http_metrics::install(svr);
+
     // ---------- CORS preflight ----------
     svr.Options(R"(.*)", [&](const httplib::Request&, httplib::Response& res){
         add_cors(res);
@@ -125,10 +141,16 @@ int main() {
     });
 
     // ---------- LIST USERS (for admin UI / future) ----------
-    // GET /users
+    // GET /users[?after_id=<username>&limit=100]  one page in username order (http_paging.h)
     // response: [ { "username": "...", "role": "...", "approved": true }, ... ]
-    svr.Get("/users", [&](const httplib::Request&, httplib::Response& res){
-        auto list = db.get_users();
+    svr.Get("/users", [&](const httplib::Request& req, httplib::Response& res){
+        add_cors(res);
+        if (http_paging::not_modified(req, res, db.table_version("users"))) {
+            return;
+        }
+        const int limit = http_paging::limit(req);
+        auto list = db.get_users(http_paging::after_id(req), limit + 1);
+        http_paging::trim_page(list, limit, res, [](const UserRow& u) { return u.username; });
         json arr = json::array();
 
         for (auto &u : list) {
@@ -139,7 +161,6 @@ int main() {
             arr.push_back(j);
         }
 
-        add_cors(res);
         res.set_content(arr.dump(), "application/json");
     });
 
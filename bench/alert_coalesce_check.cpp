@@ -0,0 +1,58 @@
+// Alert coalescing through SensorSimulator::ingest on a fresh database: a
+// sensor that stays hot for several ticks, with every alert delivered
+// (marked done) between ticks as alert_worker would, must leave one alert
+// row; cooling down and going hot again opens a second. Exits non-zero
+// otherwise.
+//
+//   ./alert_coalesce_check    (or: ctest, from the bench build directory)
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../shared/db.h"
+#include "../sensor_gateway/sensor_sim.h"
+
+static void remove_db(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+// One reading, then every pending alert delivered.
+static void tick(Database& db, SensorSimulator& sim, double temp, int ts) {
+    sim.ingest({{"SENS_HOT", temp, 1.0, 90, ts}});
+    for (const auto& a : db.get_pending_alerts(100))
+        db.mark_alert_done(a.id);
+}
+
+static bool expect(const char* what, size_t got, size_t want) {
+    std::printf("%-28s %zu alert(s)%s\n", what, got, got == want ? "" : "  FAILED");
+    return got == want;
+}
+
+int main() {
+    const std::string path = "alert_coalesce_check.db";
+    const int TICKS = 10;
+    remove_db(path);
+
+    bool ok;
+    {
+        Database db(path, 1);
+        SensorRegistry registry(db);
+        AlertRules rules;
+        rules.reload(db);
+        SensorSimulator sim(db, registry, rules, nullptr, nullptr, nullptr, nullptr, 300, 1);
+
+        int ts = 1000;
+        for (int i = 0; i < TICKS; ++i)
+            tick(db, sim, 95, ts++);
+        ok = expect("hot for 10 ticks", db.get_alerts(0, 100).size(), 1);
+
+        tick(db, sim, 25, ts++);
+        for (int i = 0; i < TICKS; ++i)
+            tick(db, sim, 95, ts++);
+        ok = expect("cooled down, then hot again", db.get_alerts(0, 100).size(), 2) && ok;
+    }
+    remove_db(path);
+    return ok ? 0 : 1;
+}
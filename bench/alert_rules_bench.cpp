@@ -0,0 +1,106 @@
+// Alert rule evaluation over reading batches, against the fixed check it
+// replaced (temperature > 80 or vibration > 9, one reading at a time):
+//   fixed    - the old inline condition
+//   default  - AlertRules with only the default rule
+//   mixed    - a rule per user for 1/10 of the fleet, per sensor for 1/100,
+//              with hysteresis and "all" combinations
+// Reports readings per second on one thread.
+//
+//   ./alert_rules_bench [sensors=100000] [ticks=50]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../shared/alert_rules.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// One batch per tick, one reading per sensor, like a simulator tick.
+static std::vector<std::vector<ReadingSample>> make_ticks(int sensors, int ticks) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> tempD(20, 90), vibD(0, 10);
+    std::uniform_int_distribution<int> battD(0, 100);
+    std::vector<std::vector<ReadingSample>> out(ticks);
+    for (int t = 0; t < ticks; ++t) {
+        out[t].reserve(sensors);
+        for (int s = 0; s < sensors; ++s)
+            out[t].push_back({"SENS_" + std::to_string(s), tempD(rng), vibD(rng), battD(rng), t});
+    }
+    return out;
+}
+
+static void report(const char* name, size_t readings, size_t fired, double secs) {
+    std::printf("%-8s %10zu readings  %8.2f M readings/s  %5.1f%% in alarm\n",
+                name, readings, readings / secs / 1e6, 100.0 * fired / readings);
+}
+
+static void run_rules(const char* name, AlertRules& rules, const std::vector<std::vector<ReadingSample>>& ticks) {
+    std::vector<uint8_t> fire;
+    rules.evaluate(ticks[0], fire);   // warm the sensor state
+    size_t total = 0, fired = 0;
+    auto t0 = Clock::now();
+    for (const auto& batch : ticks) {
+        rules.evaluate(batch, fire);
+        total += batch.size();
+        for (uint8_t f : fire) fired += f;
+    }
+    report(name, total, fired, seconds_since(t0));
+}
+
+int main(int argc, char** argv) {
+    int sensors = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int ticks = argc > 2 ? std::atoi(argv[2]) : 50;
+    auto data = make_ticks(sensors, ticks);
+
+    {
+        size_t total = 0, fired = 0;
+        auto t0 = Clock::now();
+        for (const auto& batch : data) {
+            for (const auto& r : batch) fired += (r.temp > 80 || r.vib > 9);
+            total += batch.size();
+        }
+        report("fixed", total, fired, seconds_since(t0));
+    }
+
+    AlertRules plain;
+    AlertRuleRow def;
+    def.temp_max = 80;
+    def.vib_max = 9;
+    plain.compile({def}, {});
+    run_rules("default", plain, data);
+
+    std::vector<AlertRuleRow> rules = {def};
+    std::vector<std::pair<std::string, std::string>> user_sensors;
+    for (int u = 0; u < sensors / 1000; ++u) {
+        AlertRuleRow r;
+        r.scope = "user";
+        r.target = "user" + std::to_string(u);
+        r.temp_max = 70;
+        r.batt_min = 10;
+        r.temp_hyst = 3;
+        rules.push_back(r);
+    }
+    for (int s = 0; s < sensors; s += 10)
+        user_sensors.emplace_back("SENS_" + std::to_string(s), "user" + std::to_string(s % (sensors / 1000 + 1)));
+    for (int s = 0; s < sensors; s += 100) {
+        AlertRuleRow r;
+        r.scope = "sensor";
+        r.target = "SENS_" + std::to_string(s + 1);
+        r.temp_max = 60;
+        r.vib_max = 5;
+        r.match_all = true;
+        r.vib_hyst = 0.5;
+        rules.push_back(r);
+    }
+    AlertRules mixed;
+    mixed.compile(rules, user_sensors);
+    run_rules("mixed", mixed, data);
+    return 0;
+}
@@ -0,0 +1,202 @@
+// JSON list responses, built the way the gateway routes used to build them
+// against the JsonWriter path they use now:
+//   dom     - Database::get_* into a vector of rows, one nlohmann::json
+//             object per row, json::array, dump()
+//   writer  - Database::scan_* straight off the cursor into a reused
+//             buffer with JsonWriter
+// Each response is finally copied into a body string, as
+// httplib::Response::set_content does. Reports heap allocations per row,
+// output MB/s and rows/s on one thread, for a page of alerts, a page of
+// sensors and a /readings response (rows already in memory).
+//
+//   ./json_writer_bench [page_rows=1000] [reading_rows=10000] [requests=200]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../shared/db.h"
+#include "../shared/json_writer.h"
+#include "../third_party/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+// Every operator new in the process is counted; only the timed loops read it.
+static std::atomic<uint64_t> g_allocs{0};
+
+void* operator new(size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+static void remove_db(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+// One "request" returns the body size; run() repeats it and reports.
+static void run(const char* what, const char* path, int rows, int requests,
+                const std::function<size_t()>& request) {
+    request();   // warm up: statements prepared, buffers grown
+    uint64_t a0 = g_allocs.load();
+    size_t bytes = 0;
+    auto t0 = Clock::now();
+    for (int i = 0; i < requests; ++i) bytes += request();
+    double secs = seconds_since(t0);
+    uint64_t allocs = g_allocs.load() - a0;
+
+    double total_rows = static_cast<double>(rows) * requests;
+    std::printf("%-9s %-7s %8.2f allocs/row  %8.1f MB/s  %7.2f M rows/s\n", what, path,
+                allocs / total_rows, bytes / secs / 1e6, total_rows / secs / 1e6);
+}
+
+int main(int argc, char** argv) {
+    int page_rows = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int reading_rows = argc > 2 ? std::atoi(argv[2]) : 10000;
+    int requests = argc > 3 ? std::atoi(argv[3]) : 200;
+
+    const std::string path = "bench_json.db";
+    remove_db(path);
+    Database db(path);
+
+    // Sensor ids shaped like real uuids (too long for the small-string buffer)
+    db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " +
+            std::to_string(page_rows) + ") "
+            "INSERT INTO sensors (uuid, user, commissioned, status, alert, adv_interval, config_time) "
+            "SELECT printf('%08x-1dd2-11b2-8000-%012x', i * 2654435761 % 4294967296, i), "
+            "       'user' || (i % 50), 1, 'commissioned', i % 7 = 0, 5, 1700000000 + i FROM n;");
+    db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " +
+            std::to_string(page_rows) + ") "
+            "INSERT INTO alerts (sensor_uuid, temperature, vibration, created_at) "
+            "SELECT printf('%08x-1dd2-11b2-8000-%012x', i * 2654435761 % 4294967296, i), "
+            "       80 + (i % 200) / 7.0, (i % 100) / 9.0, 1700000000 + i FROM n;");
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> tempD(20, 90), vibD(0, 10);
+    std::vector<ReadingRow> readings;
+    for (int i = 0; i < reading_rows; ++i)
+        readings.push_back({tempD(rng), vibD(rng), static_cast<int>(rng() % 101), 1700000000 + 5 * i});
+
+    std::string body;   // stands in for httplib's response body
+    std::string buf;    // the route's reused JsonWriter buffer
+
+    // ---- alerts page ----
+    run("alerts", "dom", page_rows, requests, [&] {
+        auto alerts = db.get_alerts(0, page_rows);
+        json arr = json::array();
+        for (auto& a : alerts) {
+            json row;
+            row["id"]          = a.id;
+            row["uuid"]        = a.sensor_uuid;
+            row["temperature"] = a.temperature;
+            row["vibration"]   = a.vibration;
+            row["timestamp"]   = a.created_at;
+            arr.push_back(row);
+        }
+        body = arr.dump();
+        return body.size();
+    });
+    run("alerts", "writer", page_rows, requests, [&] {
+        buf.clear();
+        JsonWriter w(buf);
+        w.begin_array();
+        db.scan_alerts(0, page_rows, [&](const AlertView& a) {
+            w.begin_object();
+            w.field("id", a.id);
+            w.field("uuid", a.sensor_uuid);
+            w.field("temperature", a.temperature);
+            w.field("vibration", a.vibration);
+            w.field("timestamp", a.created_at);
+            w.end_object();
+        });
+        w.end_array();
+        body.assign(buf.data(), buf.size());
+        return body.size();
+    });
+
+    // ---- sensors page ----
+    run("sensors", "dom", page_rows, requests, [&] {
+        auto sensors = db.get_sensors_for_user("", true, "", page_rows);
+        json arr = json::array();
+        for (auto& s : sensors) {
+            json row;
+            row["uuid"]         = s.uuid;
+            row["user"]         = s.user;
+            row["commissioned"] = s.commissioned;
+            row["status"]       = s.status;
+            row["alert"]        = s.alert;
+            row["adv_interval"] = s.adv_interval;
+            row["config_time"]  = s.config_time;
+            arr.push_back(row);
+        }
+        body = arr.dump();
+        return body.size();
+    });
+    run("sensors", "writer", page_rows, requests, [&] {
+        buf.clear();
+        JsonWriter w(buf);
+        w.begin_array();
+        db.scan_sensors_for_user("", true, "", page_rows, [&](const SensorView& s) {
+            w.begin_object();
+            w.field("uuid", s.uuid);
+            w.field("user", s.user);
+            w.field("commissioned", s.commissioned);
+            w.field("status", s.status);
+            w.field("alert", s.alert);
+            w.field("adv_interval", s.adv_interval);
+            w.field("config_time", s.config_time);
+            w.end_object();
+        });
+        w.end_array();
+        body.assign(buf.data(), buf.size());
+        return body.size();
+    });
+
+    // ---- readings (rows from the cache or the readings engine) ----
+    run("readings", "dom", reading_rows, requests, [&] {
+        json arr = json::array();
+        for (auto& r : readings) {
+            json row;
+            row["temp"] = r.temp;
+            row["vib"]  = r.vib;
+            row["batt"] = r.batt;
+            row["ts"]   = r.ts;
+            arr.push_back(row);
+        }
+        body = arr.dump();
+        return body.size();
+    });
+    run("readings", "writer", reading_rows, requests, [&] {
+        buf.clear();
+        JsonWriter w(buf);
+        w.begin_array();
+        for (auto& r : readings) {
+            w.begin_object();
+            w.field("temp", r.temp);
+            w.field("vib", r.vib);
+            w.field("batt", r.batt);
+            w.field("ts", r.ts);
+            w.end_object();
+        }
+        w.end_array();
+        body.assign(buf.data(), buf.size());
+        return body.size();
+    });
+
+    remove_db(path);
+    return 0;
+}
@@ -0,0 +1,40 @@
+// Builds a fresh database through the migrations for each readings engine
+// and runs Database::verify_query_plans() on it. Exits non-zero when a hot
+// query no longer searches the index it was given (a SCAN or a temp B-tree
+// sort), so a migration or query change that loses an index fails the
+// build's tests instead of showing up as a warning in a service log.
+//
+//   ./query_plan_check        (or: ctest, from the bench build directory)
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../shared/db.h"
+
+static void remove_db(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+static bool check(const char* engine) {
+    const std::string path = std::string("plan_check_") + engine + ".db";
+    remove_db(path);
+    setenv("DB_READINGS_ENGINE", engine, 1);
+
+    bool ok;
+    {
+        Database db(path, 1);
+        ok = db.verify_query_plans();
+    }
+    remove_db(path);
+
+    std::printf("%-8s %s\n", engine, ok ? "ok" : "FAILED (see the plan warnings)");
+    return ok;
+}
+
+int main() {
+    bool ok = check("sqlite");
+    ok = check("chunked") && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+// Compares the readings storage engines behind Database:
+//   sqlite  - one sensor_readings row per sample
+//   chunked - Gorilla-encoded per-sensor column chunks
+// Reports bytes per sample on disk, ingest rate and full-history scan rate.
+//
+//   ./readings_store_bench [sensors=200] [samples_per_sensor=2000]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <climits>
+#include <sys/stat.h>
+
+#include "../shared/db.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+static long file_size(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<long>(st.st_size) : 0;
+}
+
+static void remove_db(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+// Plausible telemetry: slow random walks at a fixed cadence, values at
+// sensor precision (0.1 C, 0.01 g, whole battery percent).
+static std::vector<std::vector<ReadingSample>> make_ticks(int sensors, int samples) {
+    std::mt19937 rng(42);
+    std::normal_distribution<double> step(0.0, 1.0);
+    std::vector<double> temp(sensors, 40.0), vib(sensors, 2.0);
+    std::vector<int> batt(sensors, 100);
+
+    std::vector<std::vector<ReadingSample>> ticks(samples);
+    const int t0 = 1700000000;
+    for (int t = 0; t < samples; ++t) {
+        ticks[t].reserve(sensors);
+        for (int s = 0; s < sensors; ++s) {
+            temp[s] += step(rng) * 0.3;
+            vib[s] = std::max(0.0, vib[s] + step(rng) * 0.05);
+            if (rng() % 500 == 0 && batt[s] > 0) batt[s]--;
+            ticks[t].push_back({"SENS_" + std::to_string(s),
+                                std::round(temp[s] * 10) / 10,
+                                std::round(vib[s] * 100) / 100,
+                                batt[s], t0 + t * 5});
+        }
+    }
+    return ticks;
+}
+
+static void run(const char* engine, const std::vector<std::vector<ReadingSample>>& ticks, int sensors) {
+    const std::string path = std::string("bench_") + engine + ".db";
+    remove_db(path);
+    setenv("DB_INIT", "1", 1);
+    setenv("DB_READINGS_ENGINE", engine, 1);
+
+    size_t total = 0;
+    for (auto& t : ticks) total += t.size();
+
+    Database db(path);
+    db.exec("PRAGMA wal_checkpoint(TRUNCATE);");
+    long base = file_size(path);
+
+    auto t0 = Clock::now();
+    for (auto& t : ticks) {
+        db.insert_readings(t);
+    }
+    double ingest_s = seconds_since(t0);
+
+    db.exec("PRAGMA wal_checkpoint(TRUNCATE);");
+    long bytes = file_size(path) - base;
+
+    t0 = Clock::now();
+    size_t scanned = 0;
+    for (int s = 0; s < sensors; ++s) {
+        scanned += db.get_readings_range("SENS_" + std::to_string(s), INT_MIN, INT_MAX, -1).size();
+    }
+    double scan_s = seconds_since(t0);
+
+    t0 = Clock::now();
+    size_t latest = 0;
+    for (int s = 0; s < sensors; ++s) {
+        latest += db.get_readings("SENS_" + std::to_string(s), 200).size();
+    }
+    double latest_s = seconds_since(t0);
+
+    std::printf("%-8s %10zu samples  %7.2f B/sample  ingest %10.0f samples/s  "
+                "scan %11.0f samples/s (%zu)  latest-200 %8.0f q/s\n",
+                engine, total, double(bytes) / total, total / ingest_s,
+                scanned / scan_s, scanned, sensors / latest_s);
+    (void)latest;
+}
+
+int main(int argc, char** argv) {
+    int sensors = argc > 1 ? std::atoi(argv[1]) : 200;
+    int samples = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    auto ticks = make_ticks(sensors, samples);
+    run("sqlite", ticks, sensors);
+    run("chunked", ticks, sensors);
+    return 0;
+}
@@ -11,6 +11,10 @@ const BATT_THRESHOLD = 20; // %
 let dataLimit = 20; // default graph points
 let selectedSensor = null;
 
+// readings of the selected sensor, oldest first; the live stream appends
+let chartRows = [];
+let readingsStream = null; // EventSource for the selected sensor
+
 // track if a sensor is currently in alert state
 const sensorAlertStates = new Map();
 
@@ -18,6 +22,24 @@ const sensorAlertStates = new Map();
 
 const $ = (id) => document.getElementById(id);
 
+// every page of a paged list route (/sensors, /users), following
+// X-Next-After-Id; the browser revalidates each page with its ETag
+async function fetchAllPages(url) {
+  const rows = [];
+  let after = null;
+  for (;;) {
+    const sep = url.includes("?") ? "&" : "?";
+    const res = await fetch(
+      after === null ? url : `${url}${sep}after_id=${encodeURIComponent(after)}`
+    );
+    const page = await res.json();
+    if (!Array.isArray(page)) return page;
+    rows.push(...page);
+    after = res.headers.get("X-Next-After-Id");
+    if (!after) return rows;
+  }
+}
+
 function showToast(message, type = "ok") {
   const container = $("toast-container");
   const el = document.createElement("div");
@@ -262,10 +284,9 @@ async function refreshUserSensors() {
   container.textContent = "Loading sensors…";
 
   try {
-    const res = await fetch(
+    const data = await fetchAllPages(
       `${GW_BASE}/sensors?user=${encodeURIComponent(session.user)}&admin=0`
     );
-    const data = await res.json();
 
     container.innerHTML = "";
     if (!data.length) {
@@ -364,6 +385,39 @@ async function selectSensor(uuid) {
   $("selected-sensor-label").textContent = uuid;
   logLine("user-log", `Selected sensor ${uuid}`);
   await refreshChartsForSensor(uuid);
+  openReadingsStream(uuid);
+}
+
+// live readings of one sensor from GET /stream, instead of re-fetching
+function openReadingsStream(uuid) {
+  if (readingsStream) readingsStream.close();
+  readingsStream = new EventSource(
+    `${GW_BASE}/stream?sensors=${encodeURIComponent(uuid)}`
+  );
+  readingsStream.addEventListener("reading", (e) => {
+    const r = JSON.parse(e.data);
+    if (r.uuid !== selectedSensor) return;
+    chartRows.push(r);
+    // keep enough for the largest resolution choice
+    const keep = maxChartPoints();
+    if (chartRows.length > keep) chartRows.splice(0, chartRows.length - keep);
+    renderCharts(uuid);
+  });
+  // events were missed (slow connection or a long reconnect): start over
+  readingsStream.addEventListener("reset", () => {
+    if (selectedSensor === uuid) refreshChartsForSensor(uuid);
+  });
+}
+
+// largest resolution choice: all a chart can show, and well inside the
+// gateway's per-sensor readings cache (READINGS_CACHE_SIZE, default 256),
+// so loading a chart never falls through to SQLite
+function maxChartPoints() {
+  const selectElement = $("data-points-select");
+  const values = selectElement
+    ? Array.from(selectElement.options, (o) => parseInt(o.value, 10) || 0)
+    : [];
+  return Math.max(dataLimit, ...values);
 }
 
 // graph resolution selector
@@ -372,7 +426,7 @@ function updateDataLimitAndRefreshCharts() {
   if (!selectElement) return;
   dataLimit = parseInt(selectElement.value, 10) || 20;
   if (selectedSensor) {
-    refreshChartsForSensor(selectedSensor);
+    renderCharts(selectedSensor);
   }
 }
 
@@ -440,105 +494,112 @@ function drawSimpleLineChart(canvasId, points, color, threshold = null) {
 async function refreshChartsForSensor(uuid) {
   try {
     const res = await fetch(
-      `${GW_BASE}/readings?uuid=${encodeURIComponent(uuid)}`
+      `${GW_BASE}/readings?uuid=${encodeURIComponent(uuid)}&max=${maxChartPoints()}`
     );
     const arr = await res.json();
-    if (!Array.isArray(arr) || !arr.length) {
-      drawSimpleLineChart("chart-temp", [], "rgba(248, 250, 252, 0.96)");
-      drawSimpleLineChart("chart-vib", [], "rgba(56, 189, 248, 0.95)");
-      drawSimpleLineChart("chart-batt", [], "rgba(34, 197, 94, 0.98)");
-      drawSimpleLineChart("chart-alert", [], "rgba(255,99,132,0.9)");
-      return;
-    }
-
-    const slice = arr.slice(-dataLimit);
-    const temps = slice.map((r) => r.temp ?? r.temperature ?? 0);
-    const vibs = slice.map((r) => r.vib ?? r.vibration ?? 0);
-    const batts = slice.map((r) => r.batt ?? r.battery ?? 0);
-    const alertsData = slice.map((r) => {
-      const t = r.temp ?? r.temperature ?? 0;
-      const v = r.vib ?? r.vibration ?? 0;
-      const b = r.batt ?? r.battery ?? 100;
-      return t > TEMP_THRESHOLD || v > VIB_THRESHOLD || b < BATT_THRESHOLD
-        ? 1
-        : 0;
-    });
-
-    drawSimpleLineChart(
-      "chart-temp",
-      temps,
-      "rgba(248, 250, 252, 0.96)",
-      TEMP_THRESHOLD
-    );
-    drawSimpleLineChart(
-      "chart-vib",
-      vibs,
-      "rgba(56, 189, 248, 0.95)",
-      VIB_THRESHOLD
-    );
-    drawSimpleLineChart(
-      "chart-batt",
-      batts,
-      "rgba(34, 197, 94, 0.98)",
-      BATT_THRESHOLD
-    );
-    drawSimpleLineChart(
-      "chart-alert",
-      alertsData,
-      "rgba(255, 99, 132, 0.9)"
-    );
-
+    // newest first from the gateway
+    chartRows = Array.isArray(arr) ? arr.slice().sort((a, b) => a.ts - b.ts) : [];
+    renderCharts(uuid);
     logLine(
       "user-log",
-      `Updated charts for ${uuid} (${slice.length} points)`
+      `Updated charts for ${uuid} (${Math.min(chartRows.length, dataLimit)} points)`
     );
+  } catch (err) {
+    console.error(err);
+    showToast("Failed to load readings.", "error");
+  }
+}
+
+// draws the newest dataLimit of chartRows
+function renderCharts(uuid) {
+  const arr = chartRows;
+  if (!arr.length) {
+    drawSimpleLineChart("chart-temp", [], "rgba(248, 250, 252, 0.96)");
+    drawSimpleLineChart("chart-vib", [], "rgba(56, 189, 248, 0.95)");
+    drawSimpleLineChart("chart-batt", [], "rgba(34, 197, 94, 0.98)");
+    drawSimpleLineChart("chart-alert", [], "rgba(255,99,132,0.9)");
+    return;
+  }
 
-    // threshold checks for latest point
-    const latest = slice[slice.length - 1];
-    if (latest) {
-      const latestTemp = latest.temp ?? latest.temperature ?? 0;
-      const latestVib = latest.vib ?? latest.vibration ?? 0;
-      const latestBatt = latest.batt ?? latest.battery ?? 100;
+  const slice = arr.slice(-dataLimit);
+  const temps = slice.map((r) => r.temp ?? r.temperature ?? 0);
+  const vibs = slice.map((r) => r.vib ?? r.vibration ?? 0);
+  const batts = slice.map((r) => r.batt ?? r.battery ?? 0);
+  const alertsData = slice.map((r) => {
+    const t = r.temp ?? r.temperature ?? 0;
+    const v = r.vib ?? r.vibration ?? 0;
+    const b = r.batt ?? r.battery ?? 100;
+    return t > TEMP_THRESHOLD || v > VIB_THRESHOLD || b < BATT_THRESHOLD
+      ? 1
+      : 0;
+  });
 
-      let isAlerting = false;
-      const alerts = [];
+  drawSimpleLineChart(
+    "chart-temp",
+    temps,
+    "rgba(248, 250, 252, 0.96)",
+    TEMP_THRESHOLD
+  );
+  drawSimpleLineChart(
+    "chart-vib",
+    vibs,
+    "rgba(56, 189, 248, 0.95)",
+    VIB_THRESHOLD
+  );
+  drawSimpleLineChart(
+    "chart-batt",
+    batts,
+    "rgba(34, 197, 94, 0.98)",
+    BATT_THRESHOLD
+  );
+  drawSimpleLineChart(
+    "chart-alert",
+    alertsData,
+    "rgba(255, 99, 132, 0.9)"
+  );
 
-      if (latestTemp > TEMP_THRESHOLD) {
-        alerts.push(
-          `Temp ${latestTemp.toFixed(1)}°C > ${TEMP_THRESHOLD}°C`
-        );
-        isAlerting = true;
-      }
-      if (latestVib > VIB_THRESHOLD) {
-        alerts.push(`Vib ${latestVib.toFixed(1)} > ${VIB_THRESHOLD}`);
-        isAlerting = true;
-      }
-      if (latestBatt < BATT_THRESHOLD) {
-        alerts.push(`Batt ${latestBatt}% < ${BATT_THRESHOLD}%`);
-        isAlerting = true;
-      }
+  // threshold checks for latest point
+  const latest = slice[slice.length - 1];
+  if (latest) {
+    const latestTemp = latest.temp ?? latest.temperature ?? 0;
+    const latestVib = latest.vib ?? latest.vibration ?? 0;
+    const latestBatt = latest.batt ?? latest.battery ?? 100;
+
+    let isAlerting = false;
+    const alerts = [];
 
-      const sensorCard = document.querySelector(
-        `.sensor-card[data-uuid="${uuid}"]`
+    if (latestTemp > TEMP_THRESHOLD) {
+      alerts.push(
+        `Temp ${latestTemp.toFixed(1)}°C > ${TEMP_THRESHOLD}°C`
       );
-      if (sensorCard) {
-        const led = sensorCard.querySelector(".led");
-        const wasAlerting = sensorAlertStates.get(uuid) || false;
-
-        if (isAlerting && !wasAlerting) {
-          led.classList.add("error");
-          showToast(`Sensor ${uuid}: ${alerts.join(", ")}`, "error");
-          sensorAlertStates.set(uuid, true);
-        } else if (!isAlerting && wasAlerting) {
-          led.classList.remove("error");
-          sensorAlertStates.set(uuid, false);
-          showToast(`Sensor ${uuid}: back within limits.`, "ok");
-        }
+      isAlerting = true;
+    }
+    if (latestVib > VIB_THRESHOLD) {
+      alerts.push(`Vib ${latestVib.toFixed(1)} > ${VIB_THRESHOLD}`);
+      isAlerting = true;
+    }
+    if (latestBatt < BATT_THRESHOLD) {
+      alerts.push(`Batt ${latestBatt}% < ${BATT_THRESHOLD}%`);
+      isAlerting = true;
+    }
+
+    const sensorCard = document.querySelector(
+      `.sensor-card[data-uuid="${uuid}"]`
+    );
+    if (sensorCard) {
+      const led = sensorCard.querySelector(".led");
+      const wasAlerting = sensorAlertStates.get(uuid) || false;
+
+      if (isAlerting && !wasAlerting) {
+        led.classList.add("error");
+        showToast(`Sensor ${uuid}: ${alerts.join(", ")}`, "error");
+        sensorAlertStates.set(uuid, true);
+      } else if (!isAlerting && wasAlerting) {
+        led.classList.remove("error");
+        sensorAlertStates.set(uuid, false);
+        showToast(`Sensor ${uuid}: back within limits.`, "ok");
       }
     }
-  } catch (err) {
-    console.error(err);
-    showToast("Failed to load readings.", "error");
   }
 }
 
@@ -692,8 +753,7 @@ async function refreshAdminUsers() {
   container.innerHTML =
     '<tr><td colspan="4" class="text-center tiny">Loading…</td></tr>';
   try {
-    const res = await fetch(`${AUTH_BASE}/users`);
-    const data = await res.json();
+    const data = await fetchAllPages(`${AUTH_BASE}/users`);
     container.innerHTML = "";
 
     data.forEach((u) => {
@@ -767,8 +827,7 @@ async function refreshAdminSensors() {
   container.classList.add("empty-state");
 
   try {
-    const res = await fetch(`${GW_BASE}/sensors?user=_&admin=1`);
-    const data = await res.json();
+    const data = await fetchAllPages(`${GW_BASE}/sensors?user=_&admin=1`);
     container.classList.remove("empty-state");
     container.innerHTML = "";
 
@@ -844,6 +903,33 @@ async function refreshAdminSensors() {
   }
 }
 
+function appendAlertLine(container, alert) {
+  const line = document.createElement("div");
+  line.className = "log-line alert-line";
+  // the gateway sends unix seconds
+  const t = new Date(
+    alert.timestamp ? alert.timestamp * 1000 : Date.now()
+  ).toLocaleTimeString();
+  line.innerHTML = `<span class="time">[${t}]</span> <span class="alert-uuid">${
+    alert.uuid || alert.sensor_uuid || "-"
+  }:</span> ${alert.message || JSON.stringify(alert)}`;
+  container.appendChild(line);
+}
+
+// new alerts pushed by GET /stream while the alerts tab is open
+function openAlertsStream() {
+  const stream = new EventSource(`${GW_BASE}/stream?alerts=1`);
+  stream.addEventListener("alert", (e) => {
+    const container = $("admin-alerts-panel");
+    // replaces the "No active alerts." placeholder
+    if (container.querySelector(".muted")) container.innerHTML = "";
+    appendAlertLine(container, JSON.parse(e.data));
+    container.scrollTop = container.scrollHeight;
+  });
+  stream.addEventListener("reset", refreshAdminAlerts);
+  return stream;
+}
+
 async function refreshAdminAlerts() {
   const container = $("admin-alerts-panel");
   container.textContent = "Fetching alerts…";
@@ -858,16 +944,7 @@ async function refreshAdminAlerts() {
     }
 
     container.innerHTML = "";
-    data.forEach((alert) => {
-      const line = document.createElement("div");
-      line.className = "log-line alert-line";
-      const t = new Date(alert.timestamp || Date.now()).toLocaleTimeString();
-      line.innerHTML = `<span class="time">[${t}]</span> <span class="alert-uuid">${
-        alert.uuid || alert.sensor_uuid || "-"
-      }:</span> ${alert.message || JSON.stringify(alert)}`;
-      container.appendChild(line);
-    });
-
+    data.forEach((alert) => appendAlertLine(container, alert));
     container.scrollTop = container.scrollHeight;
   } catch (err) {
     console.error(err);
@@ -879,7 +956,7 @@ async function refreshAdminAlerts() {
 function initAdminTabs() {
   const tabs = document.querySelectorAll(".admin-tab");
   const bodies = document.querySelectorAll(".admin-tab-body");
-  let alertsInterval = null;
+  let alertsStream = null;
 
   tabs.forEach((btn) => {
     btn.addEventListener("click", () => {
@@ -890,14 +967,14 @@ function initAdminTabs() {
       btn.classList.add("active");
       $(targetId).classList.add("active");
 
-      // stop alerts polling when leaving alerts tab
-      if (alertsInterval) {
-        clearInterval(alertsInterval);
-        alertsInterval = null;
+      // stop the alerts stream when leaving alerts tab
+      if (alertsStream) {
+        alertsStream.close();
+        alertsStream = null;
       }
       if (targetId === "admin-alerts") {
         refreshAdminAlerts();
-        alertsInterval = setInterval(refreshAdminAlerts, 5000);
+        alertsStream = openAlertsStream();
       }
     });
   });
@@ -0,0 +1,79 @@
+#include "dead_letter_replay.h"
+#include "../shared/log.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+DeadLetterReplayer::DeadLetterReplayer(Database& db, AlertWakeSender* wake)
+    : db_(db), wake_(wake) {}
+
+DeadLetterReplayer::~DeadLetterReplayer() {
+    cancel();
+    if (thread_.joinable()) thread_.join();
+}
+
+bool DeadLetterReplayer::start(const DeadLetterFilter& filter, int batch, int rate, int64_t max) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (status_.running) return false;
+    if (thread_.joinable()) thread_.join();   // the previous run has finished
+
+    cancel_ = false;
+    status_ = ReplayStatus();
+    status_.running = true;
+    status_.filter = filter;
+    status_.started_at = time(nullptr);
+    thread_ = std::thread(&DeadLetterReplayer::run, this, filter, std::max(1, batch), std::max(1, rate), max);
+    return true;
+}
+
+void DeadLetterReplayer::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        cancel_ = true;
+    }
+    cv_.notify_all();
+}
+
+ReplayStatus DeadLetterReplayer::status() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return status_;
+}
+
+void DeadLetterReplayer::run(DeadLetterFilter filter, int batch, int rate, int64_t max) {
+    Logger::instance().info("Dead-letter replay started: sensor=" +
+                            (filter.sensor_uuid.empty() ? std::string("*") : filter.sensor_uuid) +
+                            " batch=" + std::to_string(batch) + " rate=" + std::to_string(rate) + "/s");
+    int64_t total = 0;
+    std::string error;
+    while (true) {
+        int want = batch;
+        if (max > 0) want = static_cast<int>(std::min<int64_t>(want, max - total));
+        if (want <= 0) break;
+
+        int n = db_.replay_dead_letters(filter, want);
+        if (n < 0) {
+            error = "replay transaction failed";
+            break;
+        }
+        total += n;
+        if (n > 0 && wake_) wake_->notify();
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        status_.replayed = total;
+        if (n < want) break;   // nothing left that matches
+        // Pace the next batch so the worker sees at most `rate` alerts/s.
+        auto pause = std::chrono::milliseconds(static_cast<int64_t>(n) * 1000 / rate);
+        if (cv_.wait_for(lock, pause, [this] { return cancel_; })) {
+            error = "cancelled";
+            break;
+        }
+    }
+
+    Logger::instance().info("Dead-letter replay finished: " + std::to_string(total) + " alerts" +
+                            (error.empty() ? "" : " (" + error + ")"));
+    std::lock_guard<std::mutex> lock(mtx_);
+    status_.running = false;
+    status_.replayed = total;
+    status_.finished_at = time(nullptr);
+    status_.error = error;
+}
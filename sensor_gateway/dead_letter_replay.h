@@ -0,0 +1,42 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "../shared/db.h"
+#include "../shared/alert_wake.h"
+
+struct ReplayStatus {
+    bool running = false;
+    DeadLetterFilter filter;
+    int64_t replayed = 0;
+    int64_t started_at = 0;     // unix seconds, 0 = never started
+    int64_t finished_at = 0;
+    std::string error;
+};
+
+// Turns dead letters back into pending alerts in background batches, each
+// its own short transaction, paced to `rate` alerts per second so a
+// receiver that just came back is not flooded. One replay at a time.
+class DeadLetterReplayer {
+public:
+    DeadLetterReplayer(Database& db, AlertWakeSender* wake = nullptr);
+    ~DeadLetterReplayer();
+
+    // max = 0 replays every match. False if a replay is already running.
+    bool start(const DeadLetterFilter& filter, int batch, int rate, int64_t max);
+    void cancel();
+    ReplayStatus status() const;
+
+private:
+    void run(DeadLetterFilter filter, int batch, int rate, int64_t max);
+
+    Database& db_;
+    AlertWakeSender* wake_;
+    std::thread thread_;
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    bool cancel_ = false;
+    ReplayStatus status_;
+};
@@ -0,0 +1,177 @@
+#include "event_stream.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include "../third_party/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+// Bounds the time a client holds the hub lock while copying out.
+static const size_t MAX_CHUNK_BYTES = 256 * 1024;
+
+// Shortest of %.15g / %.17g that reads back exactly, like json::dump().
+static void put_double(std::string& out, double v) {
+    char buf[32];
+    if (!std::isfinite(v)) {
+        out += "null";
+        return;
+    }
+    std::snprintf(buf, sizeof(buf), "%.15g", v);
+    if (std::strtod(buf, nullptr) != v) std::snprintf(buf, sizeof(buf), "%.17g", v);
+    out += buf;
+}
+
+EventHub::EventHub(size_t buffer, int max_clients)
+    : capacity_(buffer ? buffer : 1), max_clients_(max_clients),
+      // Ids keep growing across restarts, so a Last-Event-ID from before one
+      // is never mistaken for a buffered event.
+      next_id_(static_cast<uint64_t>(time(nullptr)) * 1000000),
+      clients_gauge_(Metrics::instance().gauge("sse_clients", "Open GET /stream connections")),
+      events_(Metrics::instance().counter("sse_events_total", "Events published to GET /stream")) {}
+
+void EventHub::publish_readings(const std::vector<ReadingSample>& batch) {
+    std::vector<size_t> wanted;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (all_sensor_clients_ == 0 && watched_.empty()) return;
+        if (all_sensor_clients_ > 0) {
+            wanted.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i) wanted[i] = i;
+        } else {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (watched_.count(batch[i].sensor_uuid)) wanted.push_back(i);
+            }
+        }
+    }
+    if (wanted.empty()) return;
+
+    // Serialized outside the lock; push() only moves the strings in
+    std::vector<Event> events;
+    events.reserve(wanted.size());
+    std::hash<std::string> hasher;
+    for (size_t i : wanted) {
+        const auto& r = batch[i];
+        Event e;
+        e.hash = hasher(r.sensor_uuid);
+        e.alert = false;
+        e.uuid = r.sensor_uuid;
+        e.body = "event: reading\ndata: {\"uuid\":" + json(r.sensor_uuid).dump() + ",\"temp\":";
+        put_double(e.body, r.temp);
+        e.body += ",\"vib\":";
+        put_double(e.body, r.vib);
+        e.body += ",\"batt\":" + std::to_string(r.batt) + ",\"ts\":" + std::to_string(r.ts) + "}\n\n";
+        events.push_back(std::move(e));
+    }
+    push(events);
+}
+
+void EventHub::publish_alert(const std::string& uuid, double temp, double vib, const char* kind, int ts) {
+    json j;
+    j["uuid"]        = uuid;
+    j["temperature"] = temp;
+    j["vibration"]   = vib;
+    j["kind"]        = kind;
+    j["timestamp"]   = ts;
+
+    std::vector<Event> events(1);
+    events[0].hash = 0;
+    events[0].alert = true;
+    events[0].uuid = uuid;
+    events[0].body = "event: alert\ndata: " + j.dump() + "\n\n";
+    push(events);
+}
+
+void EventHub::push(std::vector<Event>& events) {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& e : events) {
+            e.id = next_id_++;
+            ring_.push_back(std::move(e));
+        }
+        while (ring_.size() > capacity_) ring_.pop_front();
+    }
+    events_.inc(events.size());
+    cv_.notify_all();
+}
+
+bool EventHub::subscribe(const Filter& f) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (closed_ || clients_ >= max_clients_) return false;
+    clients_++;
+    if (f.all_sensors) all_sensor_clients_++;
+    for (const auto& uuid : f.sensors) watched_[uuid]++;
+    clients_gauge_.set(clients_);
+    return true;
+}
+
+void EventHub::unsubscribe(const Filter& f) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    clients_--;
+    if (f.all_sensors) all_sensor_clients_--;
+    for (const auto& uuid : f.sensors) {
+        auto it = watched_.find(uuid);
+        if (it != watched_.end() && --it->second == 0) watched_.erase(it);
+    }
+    clients_gauge_.set(clients_);
+}
+
+uint64_t EventHub::start_cursor(uint64_t last_event_id) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    uint64_t newest = next_id_ - 1;
+    if (last_event_id == 0) return newest;
+    uint64_t oldest = next_id_ - ring_.size();
+    if (last_event_id + 1 >= oldest && last_event_id <= newest) return last_event_id;
+    // Reconnected after a gap we no longer hold: next() sends a reset
+    return 0;
+}
+
+bool EventHub::matches(const Event& e, const Filter& f, const std::vector<size_t>& hashes) {
+    if (e.alert) return f.alerts;
+    if (f.all_sensors) return true;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (hashes[i] == e.hash && f.sensors[i] == e.uuid) return true;
+    }
+    return false;
+}
+
+bool EventHub::next(uint64_t& cursor, const Filter& f, std::string& out, std::chrono::milliseconds wait) {
+    std::vector<size_t> hashes;
+    std::hash<std::string> hasher;
+    for (const auto& uuid : f.sensors) hashes.push_back(hasher(uuid));
+
+    auto deadline = std::chrono::steady_clock::now() + wait;
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (!closed_) {
+        uint64_t oldest = next_id_ - ring_.size();
+        if (cursor + 1 < oldest) {
+            // Fell behind the ring (or resumed past it): the client refetches
+            out += "event: reset\ndata: {}\n\n";
+            cursor = next_id_ - 1;
+            return true;
+        }
+        char id[32];
+        for (size_t i = cursor + 1 - oldest; i < ring_.size() && out.size() < MAX_CHUNK_BYTES; ++i) {
+            const Event& e = ring_[i];
+            cursor = e.id;
+            if (!matches(e, f, hashes)) continue;
+            std::snprintf(id, sizeof(id), "id: %llu\n", static_cast<unsigned long long>(e.id));
+            out += id;
+            out += e.body;
+        }
+        if (!out.empty()) return true;
+        if (!cv_.wait_until(lock, deadline, [&] { return closed_ || next_id_ - 1 > cursor; })) {
+            return true;   // nothing for this client before the deadline
+        }
+    }
+    return false;
+}
+
+void EventHub::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
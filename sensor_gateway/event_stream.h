@@ -0,0 +1,80 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../shared/models.h"
+#include "../shared/metrics.h"
+
+// Live feed for GET /stream (Server-Sent Events). ingest() publishes each
+// committed batch once; every event is serialized a single time into a
+// bounded ring and each connected client copies out the ones it subscribed
+// to, so N dashboards cost N memcpys rather than N DB queries.
+//
+// Readings are only serialized for sensors some client is watching (or
+// when a client watches all of them); alerts always are.
+class EventHub {
+public:
+    // What one client receives.
+    struct Filter {
+        bool all_sensors = false;
+        std::vector<std::string> sensors;   // readings of these uuids
+        bool alerts = false;
+    };
+
+    // buffer: events kept for clients that fall behind or reconnect with
+    // Last-Event-ID. max_clients: open streams allowed at once.
+    EventHub(size_t buffer, int max_clients);
+
+    void publish_readings(const std::vector<ReadingSample>& batch);
+    void publish_alert(const std::string& uuid, double temp, double vib, const char* kind, int ts);
+
+    // Reserves a client slot and registers its sensors; false when all
+    // max_clients slots are taken. Every successful subscribe() needs an
+    // unsubscribe() with the same filter.
+    bool subscribe(const Filter& f);
+    void unsubscribe(const Filter& f);
+
+    // Where a new client starts: after `last_event_id` if that event is
+    // still buffered, otherwise at the newest event.
+    uint64_t start_cursor(uint64_t last_event_id) const;
+
+    // Appends the SSE text of buffered events after `cursor` that pass `f`
+    // to `out` and advances `cursor`, waiting up to `wait` for one. An
+    // "event: reset" means events were dropped before the client read them.
+    // Returns false once close() has been called.
+    bool next(uint64_t& cursor, const Filter& f, std::string& out, std::chrono::milliseconds wait);
+
+    // Wakes every waiting client and ends their streams (shutdown).
+    void close();
+
+private:
+    struct Event {
+        uint64_t id;
+        size_t hash;          // of uuid; 0 for alerts
+        bool alert;
+        std::string uuid;
+        std::string body;     // "event: ...\ndata: ...\n\n"
+    };
+
+    void push(std::vector<Event>& events);
+    static bool matches(const Event& e, const Filter& f, const std::vector<size_t>& hashes);
+
+    const size_t capacity_;
+    const int max_clients_;
+
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<Event> ring_;
+    uint64_t next_id_;              // id of the next event published
+    bool closed_ = false;
+    int clients_ = 0;
+    int all_sensor_clients_ = 0;
+    std::unordered_map<std::string, int> watched_;   // uuid -> clients watching it
+    Gauge& clients_gauge_;
+    Counter& events_;
+};
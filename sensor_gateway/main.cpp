@@ -15,23 +15,29 @@ using json = nlohmann::json;
 #include <chrono>
 #include <thread>
 #include <atomic> // For std::atomic_bool
+#include <algorithm>
+#include <ctime>
+#include <climits>
+#include <sstream>
 
 #include "../shared/db.h"
 #include "../shared/log.h"
 #include "../third_party/httplib.h"
 #include "../third_party/nlohmann/json.hpp"
 #include "sensor_sim.h"
+#include "reading_cache.h"
+#include "sensor_registry.h"
+#include "event_stream.h"
+#include "retention.h"
+#include "dead_letter_replay.h"
+#include "../shared/http_metrics.h"
+#include "../shared/http_paging.h"
+#include "../shared/json_writer.h"
+#include "../shared/alert_rules.h"
+#include "../shared/anomaly_detector.h"
 
 using json = nlohmann::json;
 
-// Function to load all sensor UUIDs from the database
-std::vector<std::string> load_all_sensor_uuids(Database& db) {
-    Logger::instance().info("Loading all sensor UUIDs from database...");
-    std::vector<std::string> uuids = db.get_sensors(); // Assuming get_sensors() returns all UUIDs
-    Logger::instance().info("Loaded " + std::to_string(uuids.size()) + " sensor UUIDs.");
-    return uuids;
-}
-
 static std::string get_db_path() {
     if (const char* env = std::getenv("DB_PATH")) {
         if (*env) return std::string(env);
@@ -40,37 +46,200 @@ static std::string get_db_path() {
     return "/app/data/iot.db";
 }
 
+// Read-only connections in the DB pool (0 = single shared connection)
+static int get_db_readers() {
+    if (const char* env = std::getenv("DB_READERS")) {
+        if (*env) return std::max(0, std::atoi(env));
+    }
+    return 4;
+}
+
+// Body of the list responses on this server thread, written with
+// JsonWriter. It keeps its capacity between requests, so a response only
+// allocates its copy into httplib's body; one that grew past KEEP_BYTES
+// is given back rather than pinned to the thread.
+static std::string& json_buffer() {
+    static const size_t KEEP_BYTES = 4 << 20;
+    thread_local std::string buf;
+    if (buf.capacity() > KEEP_BYTES) std::string().swap(buf);
+    buf.clear();
+    return buf;
+}
+
+// "90", "60s", "5m", "1h", "1d" -> seconds (0 if malformed)
+static int parse_bucket(const std::string& s) {
+    if (s.empty()) return 0;
+    size_t used = 0;
+    long n = 0;
+    try { n = std::stol(s, &used); } catch (...) { return 0; }
+    std::string unit = s.substr(used);
+    long mult = 0;
+    if (unit.empty() || unit == "s") mult = 1;
+    else if (unit == "m") mult = 60;
+    else if (unit == "h") mult = 3600;
+    else if (unit == "d") mult = 86400;
+    if (mult == 0 || n <= 0 || n * mult > INT_MAX) return 0;
+    return static_cast<int>(n * mult);
+}
+
+// Readings kept in memory per viewed sensor for GET /readings
+static size_t get_readings_cache_size() {
+    if (const char* env = std::getenv("READINGS_CACHE_SIZE")) {
+        if (*env) return static_cast<size_t>(std::max(1, std::atoi(env)));
+    }
+    return 256;
+}
+
+// Breaches of one sensor within this many seconds fold into one alert
+static int get_alert_coalesce_secs() {
+    if (const char* env = std::getenv("ALERT_COALESCE_SECS")) {
+        if (*env) return std::max(0, std::atoi(env));
+    }
+    return 300;
+}
+
+static int env_int(const char* name, int def) {
+    if (const char* env = std::getenv(name)) {
+        if (*env) return std::max(0, std::atoi(env));
+    }
+    return def;
+}
+
+// Age limits in days (0 = keep forever) and pacing of the retention task
+static RetentionPolicy get_retention_policy() {
+    RetentionPolicy p;
+    p.readings_days = env_int("RETENTION_READINGS_DAYS", p.readings_days);
+    p.rollups_days  = env_int("RETENTION_ROLLUPS_DAYS", p.rollups_days);
+    p.alerts_days   = env_int("RETENTION_ALERTS_DAYS", p.alerts_days);
+    p.interval_secs = std::max(1, env_int("RETENTION_INTERVAL_SECS", p.interval_secs));
+    p.batch_rows    = std::max(1, env_int("RETENTION_BATCH_ROWS", p.batch_rows));
+    p.budget_ms     = std::max(1, env_int("RETENTION_BUDGET_MS", p.budget_ms));
+    return p;
+}
+
+// Fixed seed for the simulator's readings (0 = random each run)
+static uint64_t get_seed(const char* name, uint64_t def) {
+    if (const char* env = std::getenv(name)) {
+        if (*env) return std::strtoull(env, nullptr, 10);
+    }
+    return def;
+}
+
+static double env_double(const char* name, double def) {
+    if (const char* env = std::getenv(name)) {
+        if (*env) return std::max(0.0, std::atof(env));
+    }
+    return def;
+}
+
+// Thresholds and half-lives (in readings) of the anomaly detector
+static AnomalyOptions get_anomaly_options() {
+    AnomalyOptions o;
+    o.half_life      = std::max(1.0, env_double("ANOMALY_HALF_LIFE", o.half_life));
+    o.fast_half_life = std::max(1.0, env_double("ANOMALY_FAST_HALF_LIFE", o.fast_half_life));
+    o.z              = env_double("ANOMALY_Z", o.z);
+    o.persist        = std::max(1, env_int("ANOMALY_PERSIST", o.persist));
+    o.drift          = env_double("ANOMALY_DRIFT", o.drift);
+    o.warmup         = env_int("ANOMALY_WARMUP", o.warmup);
+    return o;
+}
+
+// Live stream (GET /stream): events kept for slow or reconnecting clients,
+// and how many streams may be open at once (each holds a server thread)
+static size_t get_sse_buffer() {
+    return static_cast<size_t>(std::max(1, env_int("SSE_BUFFER", 65536)));
+}
+
+static int get_sse_max_clients() {
+    return env_int("SSE_MAX_CLIENTS", 64);
+}
+
+// LOADGEN_SENSORS > 0 replaces the simulator with the load generator
+static LoadGenOptions get_load_gen_options() {
+    LoadGenOptions o;
+    o.sensors       = env_int("LOADGEN_SENSORS", o.sensors);
+    o.threads       = std::max(1, env_int("LOADGEN_THREADS", o.threads));
+    o.seed          = get_seed("LOADGEN_SEED", o.seed);
+    if (const char* env = std::getenv("LOADGEN_MODE")) {
+        if (*env) o.open_loop = std::string(env) != "closed";
+    }
+    o.interval_min  = std::max(1, env_int("LOADGEN_INTERVAL_MIN", o.interval_min));
+    o.interval_max  = std::max(o.interval_min, env_int("LOADGEN_INTERVAL_MAX", o.interval_max));
+    o.batch         = std::max(1, env_int("LOADGEN_BATCH", o.batch));
+    o.duration_secs = env_int("LOADGEN_DURATION_SECS", o.duration_secs);
+    o.report_secs   = std::max(1, env_int("LOADGEN_REPORT_SECS", o.report_secs));
+    return o;
+}
+
 int main()
 {
     Logger::instance().info("SENSOR GATEWAY STARTED");
-    Database db(get_db_path());
+    Database db(get_db_path(), get_db_readers());
+
+    ReadingCache readings_cache(get_readings_cache_size());
 
-    // SensorSimulator is instantiated without initial UUIDs now, it will update dynamically
-    SensorSimulator sim(db);
+    // The gateway owns readings, so it alone enforces retention
+    RetentionWorker retention(db, get_retention_policy());
+    retention.start();
+
+    // Loaded in full once; after that only diffs are applied
+    SensorRegistry registry(db);
+    registry.refresh();
+
+    // Compiled from alert_rules; recompiled when rules or sensors change
+    AlertRules alert_rules;
+    alert_rules.reload(db);
+
+    // Per-sensor streaming statistics, alongside the rules
+    AnomalyDetector anomaly(get_anomaly_options());
+    const bool anomaly_on = env_int("ANOMALY_DETECTION", 1) != 0;
+
+    // Wakes alert_worker as soon as a tick's alerts are committed
+    AlertWakeSender alert_wake(alert_wake_dir(get_db_path()));
+
+    // Every committed batch is published here once for all GET /stream clients
+    const int sse_max_clients = get_sse_max_clients();
+    EventHub events(get_sse_buffer(), sse_max_clients);
+
+    SensorSimulator sim(db, registry, alert_rules, anomaly_on ? &anomaly : nullptr,
+                        &readings_cache, &alert_wake, &events, get_alert_coalesce_secs(),
+                        get_seed("SIM_SEED", 0));
+    DeadLetterReplayer replayer(db, &alert_wake);
     
-    // Start the sensor simulation in a background thread
-    std::thread sim_thread(&SensorSimulator::loop, &sim);
+    // Start the sensor simulation (or the load generator) in a background thread
+    const LoadGenOptions load_gen = get_load_gen_options();
+    std::thread sim_thread = load_gen.sensors > 0
+        ? std::thread(&SensorSimulator::run_load, &sim, load_gen)
+        : std::thread(&SensorSimulator::loop, &sim);
 
     // Atomic boolean to control the update thread's lifecycle
     std::atomic_bool running(true);
 
-    // Thread for periodically updating the SensorSimulator's list of sensors
+    // Picks up sensors created outside the gateway (auth_service signup).
+    // Only rows added since the last pass are read, so this stays cheap
+    // however large the fleet gets.
     std::thread update_thread([&]() {
         while (running) {
-            std::vector<std::string> current_uuids = load_all_sensor_uuids(db);
-            sim.update_sensors(current_uuids);
             std::this_thread::sleep_for(std::chrono::seconds(5)); // Update every 5 seconds
+            // New sensors may fall under a user's rule
+            if (registry.refresh() > 0) alert_rules.reload(db);
         }
     });
 
     httplib::Server svr;
+    // An open stream keeps its worker thread, so they get threads of their own
+    svr.new_task_queue = [sse_max_clients] {
+        return new httplib::ThreadPool(CPPHTTPLIB_THREAD_POOL_COUNT + sse_max_clients);
+    };
 
     // --- CORS middleware ---
     // This is the crucial part that allows the frontend to talk to the backend.
-    svr.set_pre_routing_handler([](const httplib::Request& req, httplib::Response& res) {
+    // Installed together with per-route metrics and GET /metrics.
+    http_metrics::install(svr, [](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
-        res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, If-None-Match");
         res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
+        res.set_header("Access-Control-Expose-Headers", "ETag, X-Next-After-Id");
         // If it's an OPTIONS request (a "preflight" check), we're done.
         if (req.method == "OPTIONS") {
             res.status = 204; // No Content
@@ -81,11 +250,38 @@ int main()
     });
 
 
+    Metrics& m = Metrics::instance();
+    m.gauge_fn("db_stmt_cache_hits", "Prepared statements reused from the cache",
+               [&db] { return static_cast<double>(db.stmt_cache_hits()); });
+    m.gauge_fn("db_stmt_cache_misses", "Statements prepared because the cache had none idle",
+               [&db] { return static_cast<double>(db.stmt_cache_misses()); });
+    m.gauge_fn("db_size_bytes", "Database file size", [&db] { return static_cast<double>(db.size_bytes()); });
+    m.gauge_fn("alerts_pending", "Alerts not yet delivered or given up on",
+               [&db] { return static_cast<double>(db.count_pending_alerts()); });
+    m.gauge_fn("alerts_dead_letters", "Alerts given up on and waiting for replay",
+               [&db] { return static_cast<double>(db.count_dead_letters()); });
+
     // --- health check ---
     svr.Get("/health", [&](const httplib::Request&, httplib::Response& res) {
         res.set_content("OK", "text/plain");
     });
 
+    // --- DB statement cache counters ---
+    // GET /db_stats -> { "stmt_cache_hits": n, "stmt_cache_misses": n, "db_bytes": n,
+    //                   "retention": { rows removed / bytes freed by the last pass } }
+    svr.Get("/db_stats", [&](const httplib::Request&, httplib::Response& res) {
+        json reply;
+        reply["stmt_cache_hits"]   = db.stmt_cache_hits();
+        reply["stmt_cache_misses"] = db.stmt_cache_misses();
+        RetentionStats r = retention.last();
+        reply["db_bytes"] = db.size_bytes();
+        reply["retention"] = {
+            {"passes", r.passes}, {"readings", r.readings}, {"rollups", r.rollups},
+            {"alerts", r.alerts}, {"bytes_freed", r.bytes_freed}, {"ms", r.ms}
+        };
+        res.set_content(reply.dump(), "application/json");
+    });
+
     // --- init sensors for a user (after signup) ---
     // POST /init_sensors  { "username": "user1", "count": 10 }
     svr.Post("/init_sensors", [&](const httplib::Request& req, httplib::Response& res) {
@@ -104,9 +300,8 @@ int main()
                                     " count=" + std::to_string(count));
             db.create_user_sensors(username, count);
 
-            // After creating new sensors, trigger an immediate update in the simulator
-            std::vector<std::string> current_uuids = load_all_sensor_uuids(db);
-            sim.update_sensors(current_uuids);
+            // After creating new sensors, add them to the simulator right away
+            if (registry.refresh() > 0) alert_rules.reload(db);
 
             json reply;
             reply["ok"] = true;
@@ -121,8 +316,12 @@ int main()
     });
 
     // --- list sensors ---
-    // GET /sensors?user=xyz&admin=0/1
+    // GET /sensors?user=xyz&admin=0/1[&after_id=<uuid>&limit=100]
+    // One page in uuid order, see http_paging.h
     svr.Get("/sensors", [&](const httplib::Request& req, httplib::Response& res) {
+        if (http_paging::not_modified(req, res, db.table_version("sensors"))) {
+            return;
+        }
         std::string user;
         if (req.has_param("user")) {
             user = req.get_param_value("user");
@@ -134,64 +333,227 @@ int main()
 
         Logger::instance().info("Get sensors for user=" + user + " admin=" + (admin ? "1" : "0"));
 
-        auto sensors = db.get_sensors_for_user(user, admin);
-        json arr = json::array();
-        for (auto &s : sensors) {
-            json row;
-            row["uuid"]         = s.uuid;
-            row["user"]         = s.user;
-            row["commissioned"] = s.commissioned;
-            row["status"]       = s.status;
-            row["alert"]        = s.alert;
-            row["adv_interval"] = s.adv_interval;
-            row["config_time"]  = s.config_time;
-            arr.push_back(row);
+        // Written straight off the cursor; the extra row only says more follow
+        const int limit = http_paging::limit(req);
+        std::string& body = json_buffer();
+        JsonWriter w(body);
+        std::string last_uuid;
+        int rows = 0;
+        w.begin_array();
+        bool ok = db.scan_sensors_for_user(user, admin, http_paging::after_id(req), limit + 1,
+                                           [&](const SensorView& s) {
+            if (rows++ == limit) return;
+            w.begin_object();
+            w.field("uuid", s.uuid);
+            w.field("user", s.user);
+            w.field("commissioned", s.commissioned);
+            w.field("status", s.status);
+            w.field("alert", s.alert);
+            w.field("adv_interval", s.adv_interval);
+            w.field("config_time", s.config_time);
+            w.end_object();
+            last_uuid.assign(s.uuid);
+        });
+        w.end_array();
+        if (!ok) {
+            res.status = 500;
+            res.set_content("DB_ERROR", "text/plain");
+            return;
         }
-        res.set_content(arr.dump(), "application/json");
+        if (rows > limit) http_paging::set_next(res, last_uuid);
+        res.set_content(body.data(), body.size(), "application/json");
     });
 
+    // --- downsampled readings for long ranges ---
+    // GET /readings?uuid=SENS_xxx&bucket=1h[&from=ts&to=ts]
+    // -> [ { "ts", "count", "temp": {min,max,avg}, "vib": {...}, "batt": {...} }, ... ] oldest first
+    // Served from rollup tables kept up to date on insert; defaults to the last 24h.
+    auto serve_rollups = [&](const httplib::Request& req, httplib::Response& res) {
+        static const int MAX_BUCKETS = 10000;
+        int bucket = parse_bucket(req.get_param_value("bucket"));
+        if (!Database::rollup_supported(bucket)) {
+            res.status = 400;
+            res.set_content("BAD_BUCKET", "text/plain");
+            return;
+        }
+        std::string uuid = req.get_param_value("uuid");
+        int to   = req.has_param("to") ? std::stoi(req.get_param_value("to")) : static_cast<int>(time(nullptr));
+        int from = req.has_param("from") ? std::stoi(req.get_param_value("from")) : to - 24 * 3600;
+
+        auto rollups = db.get_rollups(uuid, from, to, bucket, MAX_BUCKETS);
+        std::string& body = json_buffer();
+        JsonWriter w(body);
+        w.begin_array();
+        for (auto& r : rollups) {
+            w.begin_object();
+            w.field("ts", r.bucket_ts);
+            w.field("count", r.count);
+            w.key("temp");
+            w.begin_object();
+            w.field("min", r.temp_min);
+            w.field("max", r.temp_max);
+            w.field("avg", r.temp_avg);
+            w.end_object();
+            w.key("vib");
+            w.begin_object();
+            w.field("min", r.vib_min);
+            w.field("max", r.vib_max);
+            w.field("avg", r.vib_avg);
+            w.end_object();
+            w.key("batt");
+            w.begin_object();
+            w.field("min", r.batt_min);
+            w.field("max", r.batt_max);
+            w.field("avg", r.batt_avg);
+            w.end_object();
+            w.end_object();
+        }
+        w.end_array();
+        res.set_content(body.data(), body.size(), "application/json");
+    };
+
     // --- readings for graph ---
-    // GET /readings?uuid=SENS_xxx&max=200
+    // GET /readings?uuid=SENS_xxx&max=200[&from=ts&to=ts]
     svr.Get("/readings", [&](const httplib::Request& req, httplib::Response& res) {
         if (!req.has_param("uuid")) {
             res.status = 400;
             res.set_content("MISSING_UUID", "text/plain");
             return;
         }
+        if (req.has_param("bucket")) {
+            serve_rollups(req, res);
+            return;
+        }
         std::string uuid = req.get_param_value("uuid");
         int max = 200;
         if (req.has_param("max")) {
             max = std::stoi(req.get_param_value("max"));
         }
 
-        auto readings = db.get_readings(uuid, max);
-        json arr = json::array();
+        // Served from the ring when it is deep enough; the first request for
+        // a sensor seeds it holding the writer (no transaction, it only
+        // reads) so no concurrent batch is lost. A sensor with no readings
+        // yet (or an unknown uuid) gets no ring and is answered by a
+        // one-row probe on a reader, so polling it never waits on ingest.
+        std::vector<ReadingRow> readings;
+        if (req.has_param("from") || req.has_param("to")) {
+            int from = req.has_param("from") ? std::stoi(req.get_param_value("from")) : 0;
+            int to   = req.has_param("to") ? std::stoi(req.get_param_value("to")) : INT_MAX;
+            readings = db.get_readings_range(uuid, from, to, max);
+        } else if (max > 0 && static_cast<size_t>(max) <= readings_cache.capacity()) {
+            if (!readings_cache.latest(uuid, max, readings) && !db.get_readings(uuid, 1).empty()) {
+                {
+                    Database::WriterLock hold(db);
+                    readings_cache.seed(uuid, db.get_readings(uuid, static_cast<int>(readings_cache.capacity())));
+                }
+                readings_cache.latest(uuid, max, readings);
+            }
+        } else {
+            readings = db.get_readings(uuid, max);
+        }
+
+        std::string& body = json_buffer();
+        JsonWriter w(body);
+        w.begin_array();
         for (auto &r : readings) {
-            json row;
-            row["temp"]    = r.temp;
-            row["vib"]     = r.vib;
-            row["batt"]    = r.batt;
-            row["ts"]      = r.ts;
-            arr.push_back(row);
+            w.begin_object();
+            w.field("temp", r.temp);
+            w.field("vib", r.vib);
+            w.field("batt", r.batt);
+            w.field("ts", r.ts);
+            w.end_object();
+        }
+        w.end_array();
+        res.set_content(body.data(), body.size(), "application/json");
+    });
+
+    // --- batched ingest from devices ---
+    // POST /readings/batch  [ { "uuid": "...", "temp": 21.5, "vib": 0.3, "batt": 90, "ts": 1700000000 }, ... ]
+    // "ts" is optional (defaults to server time).
+    svr.Post("/readings/batch", [&](const httplib::Request& req, httplib::Response& res) {
+        static const size_t MAX_BATCH = 50000;
+        try {
+            json j = json::parse(req.body);
+            if (!j.is_array()) {
+                res.status = 400;
+                res.set_content("EXPECTED_ARRAY", "text/plain");
+                return;
+            }
+            if (j.size() > MAX_BATCH) {
+                res.status = 413;
+                res.set_content("BATCH_TOO_LARGE", "text/plain");
+                return;
+            }
+
+            const int now = static_cast<int>(time(nullptr));
+            std::vector<ReadingSample> batch;
+            batch.reserve(j.size());
+            for (auto& r : j) {
+                ReadingSample s;
+                s.sensor_uuid = r.value("uuid", "");
+                if (s.sensor_uuid.empty()) {
+                    res.status = 400;
+                    res.set_content("MISSING_UUID", "text/plain");
+                    return;
+                }
+                s.temp = r.value("temp", 0.0);
+                s.vib  = r.value("vib", 0.0);
+                s.batt = r.value("batt", 0);
+                s.ts   = r.value("ts", 0);
+                if (s.ts <= 0) s.ts = now;
+                batch.push_back(std::move(s));
+            }
+
+            // Same path as the simulator: alert rules and anomaly detection
+            // run over the batch, which then goes in with its alerts.
+            bool ok = sim.ingest(batch);
+
+            json reply;
+            reply["ok"] = ok;
+            reply["inserted"] = ok ? batch.size() : 0;
+            if (!ok) res.status = 500;
+            res.set_content(reply.dump(), "application/json");
+        }
+        catch (...) {
+            res.status = 400;
+            res.set_content("BAD_JSON", "text/plain");
         }
-        res.set_content(arr.dump(), "application/json");
     });
 
-    // --- get all alerts ---
+    // --- list alerts ---
+    // GET /alerts[?after_id=<id>&limit=100]   one page, newest first (http_paging.h)
     svr.Get("/alerts", [&](const httplib::Request& req, httplib::Response& res) {
         try {
-            auto alerts = db.get_alerts();
-            json arr = json::array();
-            for (auto& a : alerts) {
-                json row;
-                row["id"]          = a.id;
-                row["uuid"]        = a.sensor_uuid;
-                row["temperature"] = a.temperature;
-                row["vibration"]   = a.vibration;
-                row["timestamp"]   = a.created_at; // Use created_at as timestamp
-                arr.push_back(row);
+            if (http_paging::not_modified(req, res, db.table_version("alerts"))) {
+                return;
+            }
+            // Written straight off the cursor, as for /sensors
+            const int limit = http_paging::limit(req);
+            std::string& body = json_buffer();
+            JsonWriter w(body);
+            int last_id = 0;
+            int rows = 0;
+            w.begin_array();
+            bool ok = db.scan_alerts(std::atoi(http_paging::after_id(req).c_str()), limit + 1,
+                                     [&](const AlertView& a) {
+                if (rows++ == limit) return;
+                w.begin_object();
+                w.field("id", a.id);
+                w.field("uuid", a.sensor_uuid);
+                w.field("temperature", a.temperature);
+                w.field("vibration", a.vibration);
+                w.field("timestamp", a.created_at); // Use created_at as timestamp
+                w.end_object();
+                last_id = a.id;
+            });
+            w.end_array();
+            if (!ok) {
+                res.status = 500;
+                res.set_content("DB_ERROR", "text/plain");
+                return;
             }
-            res.set_content(arr.dump(), "application/json");
+            if (rows > limit) http_paging::set_next(res, std::to_string(last_id));
+            res.set_content(body.data(), body.size(), "application/json");
         } catch (const std::exception& e) {
             Logger::instance().error("Error getting alerts: " + std::string(e.what()));
             res.status = 500;
@@ -203,6 +565,280 @@ int main()
         }
     });
 
+    // --- live readings and alerts (Server-Sent Events) ---
+    // GET /stream?sensors=SENS_1,SENS_2&alerts=1   (sensors=* for every sensor)
+    // Events: "reading" {uuid,temp,vib,batt,ts}, "alert" {uuid,temperature,
+    // vibration,kind,timestamp}, and "reset" when the client missed events
+    // (fell behind SSE_BUFFER, or reconnected too late) and should refetch.
+    // Resumes after the browser's Last-Event-ID on reconnect.
+    svr.Get("/stream", [&](const httplib::Request& req, httplib::Response& res) {
+        static const size_t MAX_SENSORS = 100;
+        EventHub::Filter filter;
+        filter.alerts = req.has_param("alerts") && req.get_param_value("alerts") != "0";
+        if (req.has_param("sensors")) {
+            std::istringstream in(req.get_param_value("sensors"));
+            std::string uuid;
+            while (std::getline(in, uuid, ',')) {
+                if (uuid == "*") filter.all_sensors = true;
+                else if (!uuid.empty()) filter.sensors.push_back(uuid);
+            }
+        }
+        if (filter.sensors.size() > MAX_SENSORS) {
+            res.status = 400;
+            res.set_content("TOO_MANY_SENSORS", "text/plain");
+            return;
+        }
+        if (!filter.alerts && !filter.all_sensors && filter.sensors.empty()) {
+            res.status = 400;
+            res.set_content("EMPTY_SUBSCRIPTION", "text/plain");
+            return;
+        }
+        if (!events.subscribe(filter)) {
+            res.status = 503;
+            res.set_content("TOO_MANY_STREAMS", "text/plain");
+            return;
+        }
+
+        uint64_t last_id = 0;
+        if (req.has_header("Last-Event-ID")) {
+            last_id = std::strtoull(req.get_header_value("Last-Event-ID").c_str(), nullptr, 10);
+        }
+        uint64_t cursor = events.start_cursor(last_id);
+
+        res.set_header("Cache-Control", "no-cache");
+        res.set_header("X-Accel-Buffering", "no");   // don't let a proxy hold events back
+        res.set_chunked_content_provider("text/event-stream",
+            [&events, filter, cursor, first = true](size_t, httplib::DataSink& sink) mutable {
+                std::string out;
+                if (first) {
+                    out = "retry: 3000\n\n";
+                    first = false;
+                }
+                if (!events.next(cursor, filter, out, std::chrono::seconds(15))) {
+                    sink.done();
+                    return true;
+                }
+                // A comment line when idle, so a dead client is noticed
+                if (out.empty()) out = ": ping\n\n";
+                return sink.write(out.data(), out.size());
+            },
+            [&events, filter](bool) { events.unsubscribe(filter); });
+    });
+
+    // --- alert notifications from alert_worker ---
+    // Each alert carries an idempotency key; one seen before (a retry of a
+    // delivery that got through) is acknowledged again but not re-applied.
+    // POST /alert_notify  "ALERT <uuid> TEMP=<t> VIB=<v> [COUNT=<n>]", header Idempotency-Key
+    svr.Post("/alert_notify", [&](const httplib::Request& req, httplib::Response& res) {
+        std::istringstream in(req.body);
+        std::string tag, uuid;
+        in >> tag >> uuid;
+        if (tag != "ALERT" || uuid.empty()) {
+            res.status = 400;
+            res.set_content("BAD_REQUEST", "text/plain");
+            return;
+        }
+        if (db.accept_alert_notices({AlertNotice{req.get_header_value("Idempotency-Key"), uuid}}) < 0) {
+            res.status = 500;
+            res.set_content("INTERNAL_SERVER_ERROR", "text/plain");
+            return;
+        }
+        res.set_content("OK", "text/plain");
+    });
+
+    // POST /alert_notify/batch  [ { "id": 1, "key": "...", "uuid": "...", "temp": 85.1, "vib": 3.2,
+    //                              "count": 4, "peak_temp": 91.0, "peak_vib": 9.6 }, ... ]
+    //   -> { "acked": [1, ...] }   ids not listed were not accepted
+    svr.Post("/alert_notify/batch", [&](const httplib::Request& req, httplib::Response& res) {
+        json arr;
+        try {
+            arr = json::parse(req.body);
+        } catch (...) {
+            res.status = 400;
+            res.set_content("BAD_REQUEST", "text/plain");
+            return;
+        }
+        if (!arr.is_array()) {
+            res.status = 400;
+            res.set_content("BAD_REQUEST", "text/plain");
+            return;
+        }
+
+        std::vector<AlertNotice> notices;
+        json acked = json::array();
+        for (const auto& a : arr) {
+            if (!a.is_object() || !a.contains("id") || !a["id"].is_number_integer()) continue;
+            std::string uuid = a.value("uuid", "");
+            if (uuid.empty()) continue;
+            notices.push_back({a.value("key", ""), uuid});
+            acked.push_back(a["id"]);
+        }
+
+        // One transaction for the whole batch: all acked or none
+        int fresh = notices.empty() ? 0 : db.accept_alert_notices(notices);
+        if (fresh < 0) {
+            res.status = 500;
+            res.set_content("INTERNAL_SERVER_ERROR", "text/plain");
+            return;
+        }
+        Logger::instance().info("Alert batch: " + std::to_string(acked.size()) + "/" +
+                                std::to_string(arr.size()) + " acked, " +
+                                std::to_string(acked.size() - fresh) + " duplicate");
+        json reply;
+        reply["acked"] = acked;
+        res.set_content(reply.dump(), "application/json");
+    });
+
+    // --- dead letters (alerts the worker gave up on) ---
+    // GET /admin/dead_letters?uuid=&from=&to=&after_id=&limit=100
+    //   from/to bound the alert's created_at; page with after_id = last id
+    svr.Get("/admin/dead_letters", [&](const httplib::Request& req, httplib::Response& res) {
+        DeadLetterFilter f;
+        int limit = 100;
+        try {
+            if (req.has_param("uuid"))     f.sensor_uuid = req.get_param_value("uuid");
+            if (req.has_param("from"))     f.from = std::stoi(req.get_param_value("from"));
+            if (req.has_param("to"))       f.to = std::stoi(req.get_param_value("to"));
+            if (req.has_param("after_id")) f.after_id = std::stoi(req.get_param_value("after_id"));
+            if (req.has_param("limit"))    limit = std::clamp(std::stoi(req.get_param_value("limit")), 1, 1000);
+        } catch (...) {
+            res.status = 400;
+            res.set_content("BAD_PARAMS", "text/plain");
+            return;
+        }
+
+        json arr = json::array();
+        for (const auto& d : db.get_dead_letters(f, limit)) {
+            arr.push_back({{"id", d.id}, {"uuid", d.sensor_uuid}, {"temperature", d.temperature},
+                           {"vibration", d.vibration}, {"attempts", d.attempts},
+                           {"created_at", d.created_at}, {"failed_at", d.failed_at},
+                           {"reason", d.reason}, {"last_error", d.last_error}});
+        }
+        res.set_content(arr.dump(), "application/json");
+    });
+
+    auto replay_status = [&]() {
+        ReplayStatus s = replayer.status();
+        return json{{"running", s.running}, {"replayed", s.replayed},
+                    {"started_at", s.started_at}, {"finished_at", s.finished_at},
+                    {"uuid", s.filter.sensor_uuid}, {"from", s.filter.from}, {"to", s.filter.to},
+                    {"error", s.error}};
+    };
+
+    // POST /admin/dead_letters/replay { "uuid": "", "from": 0, "to": ..., "max": 0,
+    //                                   "batch": 500, "rate": 200 }
+    //   -> 202 + status; the replay runs in the background (409 if one is running)
+    svr.Post("/admin/dead_letters/replay", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            json j = req.body.empty() ? json::object() : json::parse(req.body);
+            DeadLetterFilter f;
+            f.sensor_uuid = j.value("uuid", "");
+            f.from = j.value("from", f.from);
+            f.to = j.value("to", f.to);
+            int batch = j.value("batch", 500);
+            int rate = j.value("rate", 200);          // alerts per second
+            int64_t max = j.value("max", int64_t(0)); // 0 = all matching
+
+            if (!replayer.start(f, batch, rate, max)) {
+                res.status = 409;
+                res.set_content(replay_status().dump(), "application/json");
+                return;
+            }
+            res.status = 202;
+            res.set_content(replay_status().dump(), "application/json");
+        }
+        catch (...) {
+            res.status = 400;
+            res.set_content("BAD_JSON", "text/plain");
+        }
+    });
+
+    // GET /admin/dead_letters/replay -> progress of the current or last replay
+    svr.Get("/admin/dead_letters/replay", [&](const httplib::Request&, httplib::Response& res) {
+        res.set_content(replay_status().dump(), "application/json");
+    });
+
+    // DELETE /admin/dead_letters/replay -> stops a running replay after its current batch
+    svr.Delete("/admin/dead_letters/replay", [&](const httplib::Request&, httplib::Response& res) {
+        replayer.cancel();
+        res.set_content(replay_status().dump(), "application/json");
+    });
+
+    // --- alert rules ---
+    // GET /alert_rules -> [ { "id", "scope", "target", "temp_max", "vib_max", "batt_min",
+    //                         "match", "temp_hyst", "vib_hyst", "batt_hyst", "enabled" } ]
+    //   unset thresholds are null
+    svr.Get("/alert_rules", [&](const httplib::Request&, httplib::Response& res) {
+        json arr = json::array();
+        for (const auto& r : db.get_alert_rules()) {
+            arr.push_back({{"id", r.id}, {"scope", r.scope}, {"target", r.target},
+                           {"temp_max", r.temp_max ? json(*r.temp_max) : json()},
+                           {"vib_max", r.vib_max ? json(*r.vib_max) : json()},
+                           {"batt_min", r.batt_min ? json(*r.batt_min) : json()},
+                           {"match", r.match_all ? "all" : "any"},
+                           {"temp_hyst", r.temp_hyst}, {"vib_hyst", r.vib_hyst},
+                           {"batt_hyst", r.batt_hyst}, {"enabled", r.enabled}});
+        }
+        res.set_content(arr.dump(), "application/json");
+    });
+
+    // POST /alert_rules { "scope": "sensor", "target": "<uuid>", "temp_max": 70, "vib_max": null,
+    //                     "batt_min": 15, "match": "any", "temp_hyst": 2, "enabled": true }
+    //   creates or replaces the rule for (scope, target); scope "default" has target ""
+    svr.Post("/alert_rules", [&](const httplib::Request& req, httplib::Response& res) {
+        AlertRuleRow r;
+        try {
+            json j = json::parse(req.body);
+            r.scope  = j.value("scope", r.scope);
+            r.target = r.scope == "default" ? "" : j.value("target", "");
+            if (j.contains("temp_max") && !j["temp_max"].is_null()) r.temp_max = j["temp_max"].get<double>();
+            if (j.contains("vib_max") && !j["vib_max"].is_null())   r.vib_max = j["vib_max"].get<double>();
+            if (j.contains("batt_min") && !j["batt_min"].is_null()) r.batt_min = j["batt_min"].get<int>();
+            r.match_all = j.value("match", "any") == "all";
+            r.temp_hyst = j.value("temp_hyst", 0.0);
+            r.vib_hyst  = j.value("vib_hyst", 0.0);
+            r.batt_hyst = j.value("batt_hyst", 0);
+            r.enabled   = j.value("enabled", true);
+        } catch (...) {
+            res.status = 400;
+            res.set_content("BAD_JSON", "text/plain");
+            return;
+        }
+        if ((r.scope != "default" && r.target.empty()) ||
+            (r.scope != "default" && r.scope != "user" && r.scope != "sensor")) {
+            res.status = 400;
+            res.set_content("BAD_SCOPE", "text/plain");
+            return;
+        }
+        if (!db.upsert_alert_rule(r)) {
+            res.status = 500;
+            res.set_content("INTERNAL_SERVER_ERROR", "text/plain");
+            return;
+        }
+        alert_rules.reload(db);
+        json reply;
+        reply["ok"] = true;
+        reply["id"] = r.id;
+        res.set_content(reply.dump(), "application/json");
+    });
+
+    // DELETE /alert_rules?id=N
+    svr.Delete("/alert_rules", [&](const httplib::Request& req, httplib::Response& res) {
+        int id = 0;
+        try {
+            id = std::stoi(req.get_param_value("id"));
+        } catch (...) {
+            res.status = 400;
+            res.set_content("BAD_PARAMS", "text/plain");
+            return;
+        }
+        bool ok = db.delete_alert_rule(id);
+        if (ok) alert_rules.reload(db);
+        json reply;
+        reply["ok"] = ok;
+        res.set_content(reply.dump(), "application/json");
+    });
+
     // --- commission sensor ---
     // POST /commission_sensor { "uuid": "...", "config_time": 60, "adv_interval": 5 }
     svr.Post("/commission", [&](const httplib::Request& req, httplib::Response& res) {
@@ -220,6 +856,12 @@ int main()
             Logger::instance().info("Commission sensor " + uuid +
                                     " adv=" + std::to_string(interval_sec));
             bool ok = db.commission_sensor(uuid, 60, interval_sec);
+            if (ok) {
+                registry.update(uuid, [&](SensorEntry& s) {
+                    s.commissioned = true;
+                    s.adv_interval = interval_sec;
+                });
+            }
 
             json reply;
             reply["ok"] = ok;
@@ -244,6 +886,9 @@ int main()
             }
             Logger::instance().info("Decommission sensor " + uuid);
             bool ok = db.decommission_sensor(uuid);
+            if (ok) {
+                registry.update(uuid, [](SensorEntry& s) { s.commissioned = false; });
+            }
 
             json reply;
             reply["ok"] = ok;
@@ -272,6 +917,12 @@ int main()
 
             Logger::instance().info("Recommission sensor " + uuid);
             bool ok = db.recommission_sensor(uuid, config_time, adv_interval);
+            if (ok) {
+                registry.update(uuid, [&](SensorEntry& s) {
+                    s.commissioned = true;
+                    s.adv_interval = adv_interval;
+                });
+            }
 
             json reply;
             reply["ok"] = ok;
@@ -300,6 +951,7 @@ int main()
             Logger::instance().info("Update adv interval uuid=" + uuid +
                                     " adv=" + std::to_string(interval_sec));
             db.update_adv_interval(uuid, interval_sec);
+            registry.update(uuid, [&](SensorEntry& s) { s.adv_interval = interval_sec; });
 
             json reply;
             reply["ok"] = true;
@@ -314,6 +966,7 @@ int main()
     Logger::instance().info("Gateway listening on 0.0.0.0:9002");
     svr.listen("0.0.0.0", 9002);
 
+    events.close();
     running = false; // Signal update thread to stop
     sim_thread.join(); // Keep the main thread alive if the server stops
     update_thread.join();
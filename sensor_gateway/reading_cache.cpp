@@ -0,0 +1,70 @@
+#include "reading_cache.h"
+#include <algorithm>
+
+ReadingCache::ReadingCache(size_t per_sensor)
+    : capacity_(per_sensor > 0 ? per_sensor : 1) {}
+
+ReadingCache::Ring* ReadingCache::find(const std::string& uuid) const {
+    std::shared_lock<std::shared_mutex> lock(map_mtx_);
+    auto it = rings_.find(uuid);
+    return it == rings_.end() ? nullptr : it->second.get();
+}
+
+void ReadingCache::append(const std::vector<ReadingSample>& batch) {
+    for (const auto& s : batch) {
+        Ring* ring = find(s.sensor_uuid);
+        if (!ring) continue;
+
+        std::lock_guard<std::mutex> lock(ring->mtx);
+        // Older than everything kept: not among the latest, as in the DB
+        if (ring->count == capacity_ && s.ts < ring->buf[ring->head].ts) continue;
+
+        // Written over the oldest slot when full, then moved back past any
+        // newer rows, so a backfilled sample lands where ORDER BY ts puts it
+        size_t pos = ring->head;
+        ring->buf[pos] = ReadingRow{s.temp, s.vib, s.batt, s.ts};
+        ring->head = (ring->head + 1) % capacity_;
+        if (ring->count < capacity_) ring->count++;
+        for (size_t i = 1; i < ring->count; ++i) {
+            size_t prev = (pos + capacity_ - 1) % capacity_;
+            if (ring->buf[prev].ts <= ring->buf[pos].ts) break;
+            std::swap(ring->buf[prev], ring->buf[pos]);
+            pos = prev;
+        }
+    }
+}
+
+void ReadingCache::seed(const std::string& uuid, const std::vector<ReadingRow>& newest_first) {
+    // Unknown / empty sensors get no ring, so random uuids cost nothing.
+    if (newest_first.empty()) return;
+
+    std::unique_lock<std::shared_mutex> lock(map_mtx_);
+    if (rings_.count(uuid)) return;
+
+    auto ring = std::make_unique<Ring>();
+    ring->buf.resize(capacity_);
+    size_t n = std::min(newest_first.size(), capacity_);
+    // Oldest first, so the newest row ends up just behind head.
+    for (size_t i = 0; i < n; ++i) {
+        ring->buf[i] = newest_first[n - 1 - i];
+    }
+    ring->count = n;
+    ring->head = n % capacity_;
+    rings_.emplace(uuid, std::move(ring));
+}
+
+bool ReadingCache::latest(const std::string& uuid, size_t max, std::vector<ReadingRow>& out) const {
+    Ring* ring = find(uuid);
+    if (!ring) return false;
+
+    std::lock_guard<std::mutex> lock(ring->mtx);
+    size_t n = std::min(max, ring->count);
+    out.clear();
+    out.reserve(n);
+    size_t pos = ring->head;
+    for (size_t i = 0; i < n; ++i) {
+        pos = (pos + capacity_ - 1) % capacity_;
+        out.push_back(ring->buf[pos]);
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../shared/models.h"
+
+// Latest N readings per sensor by timestamp, kept in a fixed-size ring so
+// GET /readings can skip SQLite. Samples are kept in ts order like the DB
+// query, so a backfilled batch does not pass for the newest readings. A
+// sensor's ring is only created when it is first seeded from the DB, so
+// memory is N * sizeof(ReadingRow) per sensor being viewed.
+//
+// Consistency: append() and seed() must both run while the caller holds the
+// Database writer (a Database::Transaction for append, a WriterLock is
+// enough for seed); that orders a seed's DB snapshot against every batch, so
+// a batch is never missed or counted twice.
+class ReadingCache {
+public:
+    explicit ReadingCache(size_t per_sensor);
+
+    size_t capacity() const { return capacity_; }
+
+    // Push committed samples; sensors without a seeded ring are skipped.
+    void append(const std::vector<ReadingSample>& batch);
+
+    // Newest-first rows from the DB (at most capacity()); no-op if seeded.
+    void seed(const std::string& uuid, const std::vector<ReadingRow>& newest_first);
+
+    // Newest-first copy of up to `max` rows; false if the sensor isn't seeded.
+    bool latest(const std::string& uuid, size_t max, std::vector<ReadingRow>& out) const;
+
+private:
+    struct Ring {
+        mutable std::mutex mtx;
+        std::vector<ReadingRow> buf;   // capacity_ slots
+        size_t head = 0;               // next write position
+        size_t count = 0;
+    };
+
+    Ring* find(const std::string& uuid) const;
+
+    const size_t capacity_;
+    mutable std::shared_mutex map_mtx_;
+    std::unordered_map<std::string, std::unique_ptr<Ring>> rings_;
+};
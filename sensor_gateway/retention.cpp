@@ -0,0 +1,106 @@
+#include "retention.h"
+#include "../shared/log.h"
+#include <chrono>
+#include <ctime>
+
+using Clock = std::chrono::steady_clock;
+
+RetentionWorker::RetentionWorker(Database& db, const RetentionPolicy& policy)
+    : db_(db), policy_(policy) {}
+
+RetentionWorker::~RetentionWorker() {
+    stop();
+}
+
+void RetentionWorker::start() {
+    if (thread_.joinable()) return;
+    stop_ = false;
+    thread_ = std::thread(&RetentionWorker::loop, this);
+}
+
+void RetentionWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+RetentionStats RetentionWorker::last() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return last_;
+}
+
+// Repeats `purge` until it finds nothing more or the budget runs out.
+template <typename Purge>
+static int64_t drain(int days, int budget_ms, Purge purge) {
+    if (days <= 0) return 0;
+
+    const int cutoff = static_cast<int>(time(nullptr)) - days * 86400;
+    const auto deadline = Clock::now() + std::chrono::milliseconds(budget_ms);
+    int64_t total = 0;
+    while (true) {
+        int n = purge(cutoff);
+        if (n <= 0) break;
+        total += n;
+        if (Clock::now() >= deadline) break;
+        // Let the simulator and HTTP writers in between batches.
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return total;
+}
+
+RetentionStats RetentionWorker::run_pass() {
+    const auto started = Clock::now();
+    const int batch = policy_.batch_rows;
+    RetentionStats s;
+
+    s.readings = drain(policy_.readings_days, policy_.budget_ms,
+                       [&](int cutoff) { return db_.purge_readings(cutoff, batch); });
+    s.rollups = drain(policy_.rollups_days, policy_.budget_ms,
+                      [&](int cutoff) { return db_.purge_rollups(cutoff, batch); });
+    s.alerts = drain(policy_.alerts_days, policy_.budget_ms,
+                     [&](int cutoff) { return db_.purge_closed_alerts(cutoff, batch); });
+    // Delivery receipts only need to outlive the alerts they dedupe.
+    s.alerts += drain(policy_.alerts_days, policy_.budget_ms,
+                      [&](int cutoff) { return db_.purge_alert_receipts(cutoff, batch); });
+
+    // Free pages pile up from earlier passes too, so always try.
+    const auto deadline = Clock::now() + std::chrono::milliseconds(policy_.budget_ms);
+    while (Clock::now() < deadline) {
+        int64_t freed = db_.incremental_vacuum(policy_.vacuum_pages);
+        if (freed <= 0) break;
+        s.bytes_freed += freed;
+    }
+
+    s.ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count();
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    s.passes = last_.passes + 1;
+    last_ = s;
+    return s;
+}
+
+void RetentionWorker::loop() {
+    Logger::instance().info("Retention started: readings " + std::to_string(policy_.readings_days) +
+                            "d, rollups " + std::to_string(policy_.rollups_days) +
+                            "d, closed alerts " + std::to_string(policy_.alerts_days) + "d");
+    if (!db_.enable_incremental_vacuum())
+        Logger::instance().warn("Incremental vacuum unavailable, deleted pages will be reused but not returned");
+
+    while (true) {
+        RetentionStats s = run_pass();
+        if (s.readings || s.rollups || s.alerts || s.bytes_freed) {
+            Logger::instance().info("Retention pass: readings=" + std::to_string(s.readings) +
+                                    " rollups=" + std::to_string(s.rollups) +
+                                    " alerts=" + std::to_string(s.alerts) +
+                                    " freed=" + std::to_string(s.bytes_freed) + "B in " +
+                                    std::to_string(s.ms) + "ms, db=" + std::to_string(db_.size_bytes()) + "B");
+        }
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (cv_.wait_for(lock, std::chrono::seconds(policy_.interval_secs), [this] { return stop_; }))
+            return;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "../shared/db.h"
+
+// Age limits, in days; 0 keeps a table forever.
+struct RetentionPolicy {
+    int readings_days = 30;
+    int rollups_days = 365;
+    int alerts_days = 7;        // closed (done=1) alerts only, and delivery receipts
+    int interval_secs = 600;    // between passes
+    int batch_rows = 1000;      // rows per delete transaction
+    int budget_ms = 1000;       // per table (and for vacuum) in one pass
+    int vacuum_pages = 256;     // pages per incremental_vacuum step
+};
+
+struct RetentionStats {
+    int64_t readings = 0;
+    int64_t rollups = 0;
+    int64_t alerts = 0;
+    int64_t bytes_freed = 0;
+    int64_t ms = 0;
+    int64_t passes = 0;
+};
+
+// Background pass that deletes expired rows in small batches, each its own
+// short write transaction, then hands the freed pages back with
+// incremental_vacuum so the file shrinks without a long VACUUM lock.
+class RetentionWorker {
+public:
+    RetentionWorker(Database& db, const RetentionPolicy& policy);
+    ~RetentionWorker();
+
+    void start();
+    void stop();
+
+    // One pass now, on the calling thread.
+    RetentionStats run_pass();
+    // Counts of the most recent pass (passes = total so far).
+    RetentionStats last() const;
+
+private:
+    void loop();
+
+    Database& db_;
+    RetentionPolicy policy_;
+    std::thread thread_;
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    RetentionStats last_;
+};
@@ -0,0 +1,85 @@
+#include "sensor_registry.h"
+#include "../shared/log.h"
+
+// Rows read from the DB per refresh() round trip.
+static const int REFRESH_PAGE = 10000;
+
+class SensorRegistry::Edit {
+public:
+    explicit Edit(const Snapshot& cur) : next_(std::make_shared<Snapshot>(cur)) {}
+
+    SensorEntry& at(size_t pos) { return writable(pos / CHUNK)[pos % CHUNK]; }
+
+    size_t push_back(SensorEntry e) {
+        size_t pos = next_->size++;
+        if (pos % CHUNK == 0) {
+            auto fresh = std::make_shared<std::vector<SensorEntry>>();
+            fresh->reserve(CHUNK);
+            next_->chunks.push_back(fresh);
+            copied_[pos / CHUNK] = fresh;
+        }
+        writable(pos / CHUNK).push_back(std::move(e));
+        return pos;
+    }
+
+    std::shared_ptr<const Snapshot> done() { return next_; }
+
+private:
+    // Each touched chunk is copied once per edit, the rest stay shared.
+    std::vector<SensorEntry>& writable(size_t ci) {
+        auto it = copied_.find(ci);
+        if (it != copied_.end()) return *it->second;
+        auto copy = std::make_shared<std::vector<SensorEntry>>(*next_->chunks[ci]);
+        next_->chunks[ci] = copy;
+        copied_[ci] = copy;
+        return *copy;
+    }
+
+    std::shared_ptr<Snapshot> next_;
+    std::unordered_map<size_t, std::shared_ptr<std::vector<SensorEntry>>> copied_;
+};
+
+SensorRegistry::SensorRegistry(Database& db)
+    : db_(db), snap_(std::make_shared<Snapshot>()) {}
+
+std::shared_ptr<const SensorRegistry::Snapshot> SensorRegistry::snapshot() const {
+    return std::atomic_load(&snap_);
+}
+
+size_t SensorRegistry::refresh() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t added = 0;
+    while (true) {
+        std::vector<SensorRow> rows = db_.get_sensors_after(last_rowid_, REFRESH_PAGE);
+        if (rows.empty()) break;
+
+        Edit edit(*std::atomic_load(&snap_));
+        for (auto& r : rows) {
+            SensorEntry e{r.uuid, r.user, r.commissioned, r.adv_interval};
+            auto it = index_.find(r.uuid);
+            if (it != index_.end()) {
+                edit.at(it->second) = std::move(e);
+            } else {
+                index_.emplace(r.uuid, edit.push_back(std::move(e)));
+                added++;
+            }
+        }
+        std::atomic_store(&snap_, edit.done());
+        if (rows.size() < static_cast<size_t>(REFRESH_PAGE)) break;
+    }
+    if (added > 0)
+        Logger::instance().info("Sensor registry: " + std::to_string(added) + " new sensors, " +
+                                std::to_string(index_.size()) + " total.");
+    return added;
+}
+
+bool SensorRegistry::update(const std::string& uuid, const std::function<void(SensorEntry&)>& change) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = index_.find(uuid);
+    if (it == index_.end()) return false;
+
+    Edit edit(*std::atomic_load(&snap_));
+    change(edit.at(it->second));
+    std::atomic_store(&snap_, edit.done());
+    return true;
+}
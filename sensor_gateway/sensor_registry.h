@@ -0,0 +1,66 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../shared/db.h"
+
+// What the gateway keeps in memory about one sensor.
+struct SensorEntry {
+    std::string uuid;
+    std::string user;
+    bool commissioned = false;
+    int adv_interval = 5;       // seconds
+};
+
+// In-memory copy of the sensors table. Readers take an immutable snapshot
+// with one atomic load and can iterate it for as long as they like while
+// writers publish newer ones (RCU-style: the old snapshot is freed when its
+// last reader drops it).
+//
+// Writers apply diffs. The gateway's own routes report each change they
+// make (update()), and refresh() picks up sensors other processes added
+// (signup in auth_service) by rowid, so neither rescans the table.
+// Snapshot rows live in fixed-size chunks shared between snapshots: a diff
+// copies the chunks it touches plus the list of chunk pointers.
+class SensorRegistry {
+public:
+    static const size_t CHUNK = 512;
+
+    struct Snapshot {
+        std::vector<std::shared_ptr<const std::vector<SensorEntry>>> chunks;
+        size_t size = 0;
+
+        template <typename F>
+        void for_each(F&& f) const {
+            for (const auto& c : chunks)
+                for (const auto& s : *c) f(s);
+        }
+    };
+
+    explicit SensorRegistry(Database& db);
+
+    // Never null; cheap enough to take once per simulator tick.
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    // Adds sensors inserted since the last refresh (all of them the first
+    // time) and returns how many. Costs one indexed rowid range per call.
+    size_t refresh();
+
+    // Applies a change the caller already committed to the DB. Returns
+    // false if the sensor isn't known yet (refresh() will bring it in).
+    bool update(const std::string& uuid, const std::function<void(SensorEntry&)>& change);
+
+private:
+    // Copy-on-write view of the published snapshot, for one diff.
+    class Edit;
+
+    Database& db_;
+    std::shared_ptr<const Snapshot> snap_;      // std::atomic_load / atomic_store
+
+    std::mutex mtx_;                            // serializes writers
+    std::unordered_map<std::string, size_t> index_;   // uuid -> position
+    sqlite3_int64 last_rowid_ = 0;
+};
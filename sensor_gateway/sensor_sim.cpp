@@ -1,63 +1,283 @@
 #include "sensor_sim.h"
 #include "../shared/log.h"
+#include "../shared/metrics.h"
 #include <thread>
 #include <chrono>
 #include <random>
 #include <algorithm> // For std::find_if
+#include <atomic>
+#include <memory>
+#include <cstdio>
+#include <ctime>
 
-SensorSimulator::SensorSimulator(Database& db) : db_(db) {
+SensorSimulator::SensorSimulator(Database& db, SensorRegistry& registry, AlertRules& rules,
+                                 AnomalyDetector* anomaly, ReadingCache* cache, AlertWakeSender* wake,
+                                 EventHub* events, int coalesce_secs, uint64_t seed)
+    : db_(db), registry_(registry), rules_(rules), anomaly_(anomaly),
+      anomalies_(Metrics::instance().counter("readings_anomalous_total",
+                                             "Readings the anomaly detector flagged")),
+      cache_(cache), wake_(wake), events_(events), coalesce_secs_(coalesce_secs), seed_(seed) {
     Logger::instance().info("Initializing SensorSimulator.");
 }
 
-void SensorSimulator::update_sensors(const std::vector<std::string>& current_uuids) {
-    // Clear existing simulated sensors
-    sensors_.clear();
-    
-    // Add new sensors based on the provided UUIDs
-    for (const auto& uuid_str : current_uuids) {
-        SimSensor s;
-        s.uuid = uuid_str;
-        sensors_.push_back(s);
+bool SensorSimulator::ingest(const std::vector<ReadingSample>& batch, bool raise_alerts) {
+    std::vector<size_t> raised;   // samples that opened a new alert
+
+    // Holds the writer for the whole batch so HTTP writes can't interleave.
+    // The alarm state advances under it too, in the order batches commit
+    // (the simulator and POST /readings/batch race for it otherwise).
+    Database::Transaction tx(db_);
+    std::vector<uint8_t> fire, tripped, anomalous;
+    if (raise_alerts) {
+        rules_.evaluate(batch, fire, &tripped);
+        if (anomaly_) anomaly_->update(batch, anomalous);
+    }
+    for (size_t i = 0; raise_alerts && i < batch.size(); ++i) {
+        bool odd = anomaly_ && anomalous[i];
+        if (odd) anomalies_.inc();
+        if (!fire[i] && !odd) continue;
+        const auto& r = batch[i];
+        // A new alarm opens an alert; a sensor stuck hot folds into it
+        // (even once delivered) instead of a new row and delivery every tick.
+        const int window = tripped[i] ? 0 : coalesce_secs_;
+        if (db_.raise_alert(r.sensor_uuid, r.temp, r.vib, window) > 0) {
+            raised.push_back(i);
+            Logger::instance().warn(std::string(fire[i] ? "FAULT" : "ANOMALY") +
+                                    " -> generating alert for " + r.sensor_uuid);
+        }
+    }
+    // One multi-row insert per batch instead of one statement per sensor
+    bool ok = db_.insert_readings(batch) && tx.commit();
+    // Not stored, so these readings never happened as far as alarms go
+    if (!ok && raise_alerts) {
+        rules_.rollback();
+        if (anomaly_) anomaly_->rollback();
+    }
+    // Still under the writer, see ReadingCache
+    if (ok && cache_) cache_->append(batch);
+    // Likewise, so stream ids follow commit order
+    if (ok && events_) {
+        events_->publish_readings(batch);
+        for (size_t i : raised) {
+            const auto& r = batch[i];
+            events_->publish_alert(r.sensor_uuid, r.temp, r.vib, fire[i] ? "fault" : "anomaly", r.ts);
+        }
     }
-    Logger::instance().info("SensorSimulator updated with " + std::to_string(sensors_.size()) + " sensors.");
+    // Only once committed, so the worker's query sees the rows
+    if (ok && !raised.empty() && wake_) wake_->notify();
+    return ok;
 }
 
 void SensorSimulator::loop() {
     Logger::instance().info("Sensor simulation loop started");
 
-    std::mt19937 rng(std::random_device{}());
+    std::mt19937 rng(seed_ ? static_cast<std::mt19937::result_type>(seed_) : std::random_device{}());
     std::uniform_real_distribution<double> tempD(20, 90);
     std::uniform_real_distribution<double> vibD(0, 10);
     std::uniform_int_distribution<int> battD(20, 100);
 
     while (true) {
+        // Immutable: the registry publishes changes as a new snapshot
+        auto fleet = registry_.snapshot();
+
         // If there are no sensors being simulated, add some defaults
-        if (sensors_.empty()) {
+        if (fleet->size == 0) {
             Logger::instance().warn("No sensors in simulator, adding defaults SENS_0 to SENS_4.");
             for (int i = 0; i < 5; i++) {
-                SimSensor s;
-                s.uuid = "SENS_" + std::to_string(i);
-                sensors_.push_back(s);
-                db_.insert_uncommissioned(s.uuid); // Ensure these are in the DB as uncommissioned
+                db_.insert_uncommissioned("SENS_" + std::to_string(i)); // Ensure these are in the DB as uncommissioned
             }
+            registry_.refresh();
+            fleet = registry_.snapshot();
         }
 
-        db_.exec("BEGIN;");
-        for (auto &s : sensors_) {
+        std::vector<ReadingSample> batch;
+        batch.reserve(fleet->size);
+        const int now = static_cast<int>(time(nullptr));
+
+        fleet->for_each([&](const SensorEntry& s) {
             double t = tempD(rng);
             double vib = vibD(rng);
             int batt = battD(rng);
 
             // Insert reading only if the sensor is commissioned
             // The `db_` methods should handle this check internally if required by the DB schema
-            db_.insert_reading(s.uuid, t, vib, batt);
+            batch.push_back({s.uuid, t, vib, batt, now});
+        });
+        ingest(batch);
+        std::this_thread::sleep_for(std::chrono::seconds(3));
+    }
+}
+
+// =================== LOAD GENERATOR ===================
+
+// splitmix64: a stateless hash, so any sample can be recomputed from
+// (seed, sensor, sequence number) alone.
+static uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// [0, 1) from the top 53 bits.
+static double unit_interval(uint64_t h) {
+    return static_cast<double>(h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Cadence of virtual sensor i and the second (< interval) it first reports in.
+struct VirtualCadence {
+    int interval;
+    int phase;
+};
+
+static VirtualCadence virtual_cadence(const LoadGenOptions& opt, uint32_t i) {
+    uint64_t h = mix64(opt.seed ^ mix64(i));
+    int interval = opt.interval_min + static_cast<int>(h % uint64_t(opt.interval_max - opt.interval_min + 1));
+    return {interval, static_cast<int>((h >> 32) % uint64_t(interval))};
+}
+
+static std::string virtual_uuid(uint32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "LOAD_%07u", i);
+    return buf;
+}
 
-            if (t > 80 || vib > 9) {
-                db_.create_alert(s.uuid, t, vib);
-                Logger::instance().warn("FAULT -> generating alert for " + s.uuid);
+void SensorSimulator::run_load(const LoadGenOptions& in) {
+    LoadGenOptions opt = in;
+    opt.threads = std::max(1, opt.threads);
+    opt.interval_min = std::max(1, opt.interval_min);
+    opt.interval_max = std::max(opt.interval_min, opt.interval_max);
+    opt.batch = std::max(1, opt.batch);
+    opt.report_secs = std::max(1, opt.report_secs);
+    const uint32_t n = static_cast<uint32_t>(std::max(0, opt.sensors));
+
+    double offered = 0;   // samples/sec the fleet's cadences add up to
+    for (uint32_t i = 0; i < n; ++i)
+        offered += 1.0 / virtual_cadence(opt, i).interval;
+
+    Logger::instance().info("Load generator: " + std::to_string(n) + " virtual sensors, " +
+                            std::to_string(opt.threads) + " threads, seed " + std::to_string(opt.seed) +
+                            (opt.open_loop ? ", open loop at " + std::to_string(static_cast<long long>(offered)) +
+                                                 " samples/s"
+                                           : ", closed loop"));
+
+    Counter& samples_total = Metrics::instance().counter("loadgen_samples_total",
+                                                         "Samples the load generator got committed");
+    Gauge& lag_gauge = Metrics::instance().gauge("loadgen_lag_seconds",
+                                                 "How far the slowest open-loop generator is behind its schedule");
+
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> committed(0), failed(0);
+    // Virtual seconds each thread has finished.
+    std::unique_ptr<std::atomic<int64_t>[]> progress(new std::atomic<int64_t>[opt.threads]);
+    for (int k = 0; k < opt.threads; ++k)
+        progress[k] = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    const int start_ts = static_cast<int>(time(nullptr));
+
+    auto generate = [&](int k) {
+        // Calendar queue: slot s holds the sensors due at virtual second
+        // s (mod ring). Every interval is < ring, so a sensor is always
+        // re-queued into a later slot than the one being drained.
+        const int ring = opt.interval_max + 1;
+        std::vector<std::vector<uint32_t>> slots(ring);
+        for (uint32_t i = k; i < n; i += opt.threads)
+            slots[virtual_cadence(opt, i).phase].push_back(i);
+
+        std::vector<uint32_t> due;
+        std::vector<ReadingSample> batch;
+        batch.reserve(opt.batch);
+        auto flush = [&]() {
+            if (batch.empty()) return;
+            // Alerts for the virtual fleet would only flood the alerts
+            // table, the log and alert_worker; ingest is what is measured
+            if (ingest(batch, false)) {
+                committed += batch.size();
+                samples_total.inc(batch.size());
+            } else {
+                failed += batch.size();
+            }
+            batch.clear();
+        };
+
+        for (int64_t vt = 0; !stop; ++vt) {
+            if (opt.open_loop)
+                std::this_thread::sleep_until(start + std::chrono::seconds(vt));
+
+            due.swap(slots[vt % ring]);
+            // A closed loop outruns real time; never stamp samples in the future
+            const int ts = std::min(start_ts + static_cast<int>(vt), static_cast<int>(time(nullptr)));
+            for (uint32_t i : due) {
+                VirtualCadence c = virtual_cadence(opt, i);
+                uint64_t seq = static_cast<uint64_t>((vt - c.phase) / c.interval);
+                uint64_t h = mix64(mix64(opt.seed + i) ^ seq);
+                double t = 20 + 70 * unit_interval(h);
+                h = mix64(h);
+                double vib = 10 * unit_interval(h);
+                h = mix64(h);
+                int batt = 20 + static_cast<int>(h % 81);
+
+                batch.push_back({virtual_uuid(i), t, vib, batt, ts});
+                if (batch.size() >= static_cast<size_t>(opt.batch))
+                    flush();
+                slots[(vt + c.interval) % ring].push_back(i);
             }
+            flush();
+            due.clear();
+            progress[k] = vt + 1;
         }
-        db_.exec("COMMIT;");
-        std::this_thread::sleep_for(std::chrono::seconds(3));
+    };
+
+    std::vector<std::thread> threads;
+    for (int k = 0; k < opt.threads; ++k)
+        threads.emplace_back(generate, k);
+
+    uint64_t last = 0;
+    auto last_at = start;
+    while (true) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        auto next = last_at + std::chrono::seconds(opt.report_secs);
+        bool finished = false;
+        if (opt.duration_secs > 0) {
+            auto end = start + std::chrono::seconds(opt.duration_secs);
+            if (end <= next) {
+                next = end;
+                finished = true;
+            }
+        }
+        std::this_thread::sleep_until(next);
+
+        auto now = std::chrono::steady_clock::now();
+        uint64_t total = committed.load();
+        double window = std::chrono::duration<double>(now - last_at).count();
+        int64_t slowest = progress[0];
+        for (int k = 1; k < opt.threads; ++k)
+            slowest = std::min<int64_t>(slowest, progress[k]);
+        elapsed = now - start;
+        long long lag = opt.open_loop
+            ? std::max<long long>(0, std::chrono::duration_cast<std::chrono::seconds>(elapsed).count() - slowest)
+            : 0;
+        lag_gauge.set(static_cast<double>(lag));
+
+        Logger::instance().info("Load generator: " +
+                                std::to_string(static_cast<long long>((total - last) / window)) +
+                                " samples/s, " + std::to_string(total) + " committed, " +
+                                std::to_string(failed.load()) + " failed, " +
+                                (opt.open_loop ? "lag " + std::to_string(lag) + "s"
+                                               : "virtual clock at +" + std::to_string(slowest) + "s"));
+        last = total;
+        last_at = now;
+        if (finished)
+            break;
     }
+
+    stop = true;
+    for (auto& t : threads)
+        t.join();
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Logger::instance().info("Load generator finished: " + std::to_string(committed.load()) + " samples in " +
+                            std::to_string(static_cast<long long>(secs)) + "s, " +
+                            std::to_string(static_cast<long long>(committed.load() / secs)) + " samples/s");
 }
@@ -1,19 +1,75 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <string>
 #include "../shared/db.h"
+#include "reading_cache.h"
+#include "sensor_registry.h"
+#include "event_stream.h"
+#include "../shared/alert_rules.h"
+#include "../shared/anomaly_detector.h"
+#include "../shared/alert_wake.h"
+#include "../shared/metrics.h"
 
-struct SimSensor {
-    std::string uuid;
+// Load-generator mode (SensorSimulator::run_load): a fleet of virtual
+// sensors LOAD_0000000.. that never touch the sensors table, for
+// capacity planning of the ingest path. The samples depend only on the
+// seed, never on the thread count or on how fast the DB keeps up.
+struct LoadGenOptions {
+    int sensors = 0;            // virtual sensors; 0 = run the normal simulator
+    int threads = 1;            // generator threads, each owning sensors i % threads
+    uint64_t seed = 1;
+    // Open loop: every sensor reports at its adv_interval in real time, and
+    // a generator that falls behind reports lag instead of slowing down.
+    // Closed loop: the virtual clock advances as soon as the previous
+    // second's samples are committed, so the rate is what ingest sustains;
+    // timestamps stop at the wall clock once the virtual clock passes it.
+    // Either way the samples are only stored: no rules, anomaly detection
+    // or alerts for the virtual fleet.
+    bool open_loop = true;
+    int interval_min = 5;       // adv_interval of each sensor, drawn from
+    int interval_max = 5;       // [min, max] seconds by the seed
+    int batch = 1000;           // samples per transaction
+    int duration_secs = 0;      // 0 = until the process exits
+    int report_secs = 10;       // achieved samples/sec are logged this often
 };
 
 class SensorSimulator {
 public:
-    SensorSimulator(Database& db);
+    // Simulates every sensor in `registry`, reading a fresh snapshot each
+    // tick; readings that trip `rules`, or that `anomaly` (if set) finds
+    // anomalous, raise alerts.
+    // coalesce_secs: an alert is raised when a sensor goes into alarm; its
+    // later breaches within this window of that alert fold into it
+    // (Database::raise_alert). 0 = one per breach.
+    // events: committed readings and new alerts are published there for
+    // GET /stream.
+    // seed: 0 draws one from std::random_device.
+    SensorSimulator(Database& db, SensorRegistry& registry, AlertRules& rules,
+                    AnomalyDetector* anomaly = nullptr, ReadingCache* cache = nullptr,
+                    AlertWakeSender* wake = nullptr, EventHub* events = nullptr,
+                    int coalesce_secs = 0, uint64_t seed = 0);
     void loop();
-    void update_sensors(const std::vector<std::string>& current_uuids);
+
+    // Runs the load generator until opt.duration_secs pass (forever if 0)
+    // and logs the achieved rate. Replaces loop().
+    void run_load(const LoadGenOptions& opt);
+
+    // Stores one batch of samples and raises alerts for its breaches in one
+    // transaction; then feeds the cache and the event stream and wakes
+    // alert_worker. raise_alerts=false only stores (the load generator).
+    // Safe to call from several threads.
+    bool ingest(const std::vector<ReadingSample>& batch, bool raise_alerts = true);
 
 private:
     Database& db_;
-    std::vector<SimSensor> sensors_;
+    SensorRegistry& registry_;
+    AlertRules& rules_;
+    AnomalyDetector* anomaly_;
+    Counter& anomalies_;
+    ReadingCache* cache_;
+    AlertWakeSender* wake_;
+    EventHub* events_;
+    int coalesce_secs_;
+    uint64_t seed_;
 };
@@ -0,0 +1,144 @@
+#include "alert_rules.h"
+#include "db.h"
+#include "log.h"
+#include <limits>
+
+static const double INF = std::numeric_limits<double>::infinity();
+
+AlertRules::AlertRules() {
+    compile({}, {});
+}
+
+void AlertRules::compile(const std::vector<AlertRuleRow>& rules,
+                         const std::vector<std::pair<std::string, std::string>>& user_sensors) {
+    auto c = std::make_shared<Compiled>();
+
+    auto add = [&](const AlertRuleRow& r) {
+        bool any_set = r.temp_max || r.vib_max || r.batt_min;
+        bool all = r.match_all && any_set;
+        // Under "any" an unset condition must never hold, under "all" always.
+        double off = all ? -INF : INF;
+        c->temp_trip.push_back(r.temp_max ? *r.temp_max : off);
+        c->temp_hold.push_back(r.temp_max ? *r.temp_max - r.temp_hyst : off);
+        c->vib_trip.push_back(r.vib_max ? *r.vib_max : off);
+        c->vib_hold.push_back(r.vib_max ? *r.vib_max - r.vib_hyst : off);
+        // Battery fires below the threshold: the same, mirrored.
+        c->batt_trip.push_back(r.batt_min ? *r.batt_min : -off);
+        c->batt_hold.push_back(r.batt_min ? *r.batt_min + r.batt_hyst : -off);
+        c->match_all.push_back(all ? 1 : 0);
+        return static_cast<uint32_t>(c->match_all.size() - 1);
+    };
+
+    bool have_default = false;
+    std::unordered_map<std::string, uint32_t> by_user;
+    for (const auto& r : rules) {
+        if (!r.enabled) continue;
+        if (r.scope == "default") {
+            if (!have_default) c->fallback = add(r);
+            have_default = true;
+        } else if (r.scope == "user") {
+            by_user[r.target] = add(r);
+        } else if (r.scope == "sensor") {
+            c->by_sensor[r.target] = add(r);
+        }
+    }
+    if (!have_default) {
+        AlertRuleRow builtin;
+        builtin.temp_max = 80;
+        builtin.vib_max = 9;
+        c->fallback = add(builtin);
+    }
+    for (const auto& su : user_sensors) {
+        auto it = by_user.find(su.second);
+        if (it != by_user.end()) c->by_sensor.emplace(su.first, it->second);   // own rule wins
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    c->generation = rules_ ? rules_->generation + 1 : 1;
+    rules_ = std::move(c);
+}
+
+void AlertRules::reload(Database& db) {
+    std::vector<AlertRuleRow> rules = db.get_alert_rules();
+    compile(rules, db.get_user_rule_sensors());
+    Logger::instance().info("Loaded " + std::to_string(rules.size()) + " alert rules.");
+}
+
+size_t AlertRules::rule_count() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return rules_->match_all.size();
+}
+
+void AlertRules::evaluate(const std::vector<ReadingSample>& batch, std::vector<uint8_t>& fire,
+                          std::vector<uint8_t>* tripped) {
+    const size_t n = batch.size();
+    fire.assign(n, 0);
+    if (tripped) tripped->assign(n, 0);
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    undo_.clear();
+    if (n == 0) return;
+    const Compiled& c = *rules_;
+    rule_.resize(n);
+    temp_.resize(n);
+    vib_.resize(n);
+    batt_.resize(n);
+    trip_.resize(n);
+    hold_.resize(n);
+    sensor_.resize(n);
+
+    // Gather: the sensor's state (and rule, re-resolved after a reload)
+    // and the reading, column by column.
+    for (size_t i = 0; i < n; ++i) {
+        const ReadingSample& r = batch[i];
+        SensorState& s = state_[r.sensor_uuid];
+        undo_.emplace_back(&s, s);
+        if (s.generation != c.generation) {
+            auto it = c.by_sensor.find(r.sensor_uuid);
+            s.rule = it != c.by_sensor.end() ? it->second : c.fallback;
+            s.generation = c.generation;
+        }
+        sensor_[i] = &s;
+        rule_[i] = s.rule;
+        temp_[i] = r.temp;
+        vib_[i] = r.vib;
+        batt_[i] = r.batt;
+    }
+
+    // Both outcomes for every reading, without branches: `trip` with the
+    // rule's thresholds, `hold` with the hysteresis ones.
+    const uint32_t* rule = rule_.data();
+    const double *t = temp_.data(), *v = vib_.data(), *b = batt_.data();
+    const double *tt = c.temp_trip.data(), *th = c.temp_hold.data();
+    const double *vt = c.vib_trip.data(), *vh = c.vib_hold.data();
+    const double *bt = c.batt_trip.data(), *bh = c.batt_hold.data();
+    const uint8_t* all = c.match_all.data();
+    uint8_t* trip = trip_.data();
+    uint8_t* hold = hold_.data();
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t k = rule[i];
+        uint8_t a1 = t[i] > tt[k], b1 = v[i] > vt[k], c1 = b[i] < bt[k];
+        uint8_t a2 = t[i] > th[k], b2 = v[i] > vh[k], c2 = b[i] < bh[k];
+        uint8_t m = all[k];
+        trip[i] = m ? (a1 & b1 & c1) : (a1 | b1 | c1);
+        hold[i] = m ? (a2 & b2 & c2) : (a2 | b2 | c2);
+    }
+
+    // In order, since a sensor's reading depends on its previous one.
+    for (size_t i = 0; i < n; ++i) {
+        SensorState& s = *sensor_[i];
+        const uint8_t was = s.alarm;
+        s.alarm = was ? hold[i] : trip[i];
+        fire[i] = s.alarm;
+        if (tripped) (*tripped)[i] = s.alarm & !was;
+    }
+}
+
+void AlertRules::rollback() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    // Newest first, so a sensor with several readings ends up as it was
+    // before the first of them.
+    for (auto it = undo_.rbegin(); it != undo_.rend(); ++it)
+        *it->first = it->second;
+    undo_.clear();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "models.h"
+
+class Database;
+
+// Alert rules (alert_rules table) compiled into flat per-rule arrays and
+// evaluated over whole batches of readings.
+//
+// A rule fires when any (or all) of its set conditions hold: temperature
+// above temp_max, vibration above vib_max, battery below batt_min. While a
+// sensor is in alarm each threshold is moved back by its hysteresis
+// (temp_max - temp_hyst, batt_min + batt_hyst, ...), so readings hovering
+// at a threshold don't flap. A sensor uses its own rule, else its user's,
+// else the default; with no enabled default, temperature > 80 or
+// vibration > 9.
+//
+// evaluate() copies a batch into structure-of-arrays scratch buffers, runs
+// a branch-free pass over them for every reading, then one sequential pass
+// for the alarm state; the only per-reading hash lookup is the sensor's.
+class AlertRules {
+public:
+    AlertRules();
+
+    // Replaces the compiled rules. user_sensors maps the sensors of users
+    // with a user rule to that user (Database::get_user_rule_sensors).
+    // Sensors keep their alarm state across a reload.
+    void compile(const std::vector<AlertRuleRow>& rules,
+                 const std::vector<std::pair<std::string, std::string>>& user_sensors);
+    // compile() from the DB.
+    void reload(Database& db);
+
+    // fire[i] = 1 if batch[i] leaves its sensor in alarm. A sensor's
+    // readings must appear in time order, and its state carries over to
+    // the next batch. Thread-safe; batches are evaluated one at a time.
+    // tripped (if set): tripped[i] = 1 if batch[i] is the one that put its
+    // sensor into alarm, i.e. the rising edge a new alert belongs to.
+    void evaluate(const std::vector<ReadingSample>& batch, std::vector<uint8_t>& fire,
+                  std::vector<uint8_t>* tripped = nullptr);
+    // Puts back the alarm state the last evaluate() changed, when its batch
+    // was not stored after all. Call it before the next evaluate(), e.g.
+    // both under the same DB writer as SensorSimulator::ingest does.
+    void rollback();
+
+    size_t rule_count() const;
+
+private:
+    // One entry per rule. Unset conditions compile to thresholds that are
+    // never met under "any" and always met under "all".
+    struct Compiled {
+        std::vector<double> temp_trip, temp_hold;
+        std::vector<double> vib_trip, vib_hold;
+        std::vector<double> batt_trip, batt_hold;
+        std::vector<uint8_t> match_all;
+        std::unordered_map<std::string, uint32_t> by_sensor;   // sensors not on the default
+        uint32_t fallback = 0;
+        uint32_t generation = 0;
+    };
+
+    struct SensorState {
+        uint32_t generation = 0;   // rule resolved against this compile
+        uint32_t rule = 0;
+        uint8_t alarm = 0;
+    };
+
+    mutable std::mutex mtx_;
+    std::shared_ptr<const Compiled> rules_;
+    std::unordered_map<std::string, SensorState> state_;
+
+    // Scratch, one entry per reading of the batch being evaluated.
+    std::vector<uint32_t> rule_;
+    std::vector<double> temp_, vib_, batt_;
+    std::vector<uint8_t> trip_, hold_;
+    std::vector<SensorState*> sensor_;
+    // Each reading's sensor state as it was before the last batch.
+    std::vector<std::pair<SensorState*, SensorState>> undo_;
+};
@@ -0,0 +1,162 @@
+#include "alert_wake.h"
+#include "log.h"
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static bool make_addr(const std::string& path, sockaddr_un& addr)
+{
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+static const char SOCK_SUFFIX[] = ".sock";
+
+std::string alert_wake_dir(const std::string& db_path)
+{
+    if (const char* env = std::getenv("ALERT_WAKE_DIR"))
+        return env;
+    size_t slash = db_path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : db_path.substr(0, slash);
+    return dir + "/alert_wake.d";
+}
+
+// =================== SENDER ===================
+
+AlertWakeSender::AlertWakeSender(const std::string& dir) : dir_(dir)
+{
+    if (dir_.empty())
+        return;
+    fd_ = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+}
+
+AlertWakeSender::~AlertWakeSender()
+{
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void AlertWakeSender::notify()
+{
+    if (fd_ < 0)
+        return;
+    // Missing until the first worker starts.
+    DIR* d = opendir(dir_.c_str());
+    if (!d)
+        return;
+
+    const size_t suffix = sizeof(SOCK_SUFFIX) - 1;
+    const char byte = 1;
+    while (dirent* e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() <= suffix || name.compare(name.size() - suffix, suffix, SOCK_SUFFIX) != 0)
+            continue;
+        std::string path = dir_ + "/" + name;
+        sockaddr_un addr;
+        if (!make_addr(path, addr))
+            continue;
+        // EAGAIN: that worker has wake-ups queued already. ECONNREFUSED:
+        // nothing is bound any more, the worker stopped without cleaning up.
+        if (sendto(fd_, &byte, 1, MSG_DONTWAIT | MSG_NOSIGNAL,
+                   reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 &&
+            errno == ECONNREFUSED)
+        {
+            unlink(path.c_str());
+        }
+    }
+    closedir(d);
+}
+
+// =================== RECEIVER ===================
+
+// Worker ids are <hostname>:<pid> or WORKER_ID; keep them to one file name.
+static std::string socket_name(const std::string& name)
+{
+    std::string out = name.empty() ? "worker" : name;
+    for (char& ch : out) {
+        bool plain = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+                     (ch >= '0' && ch <= '9') || ch == '-' || ch == '_' || ch == ':' || ch == '.';
+        if (!plain)
+            ch = '_';
+    }
+    return out + SOCK_SUFFIX;
+}
+
+AlertWakeReceiver::AlertWakeReceiver(const std::string& dir, const std::string& name)
+{
+    if (dir.empty())
+        return;
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        Logger::instance().warn("Alert wake directory " + dir + " unavailable: " + std::strerror(errno));
+        return;
+    }
+    path_ = dir + "/" + socket_name(name);
+    sockaddr_un addr;
+    if (!make_addr(path_, addr)) {
+        Logger::instance().warn("Alert wake socket path too long: " + path_);
+        return;
+    }
+
+    fd_ = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd_ < 0)
+        return;
+
+    // A stale socket file from this worker's previous run would make bind fail.
+    unlink(path_.c_str());
+    if (bind(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        Logger::instance().warn("Alert wake socket " + path_ + " unavailable: " + std::strerror(errno));
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    Logger::instance().info("Listening for alert wake-ups on " + path_);
+}
+
+AlertWakeReceiver::~AlertWakeReceiver()
+{
+    if (fd_ < 0)
+        return;
+    close(fd_);
+    unlink(path_.c_str());
+}
+
+bool AlertWakeReceiver::wait(int timeout_ms)
+{
+    if (fd_ < 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return false;
+    }
+
+    pollfd p{fd_, POLLIN, 0};
+    int rc = poll(&p, 1, timeout_ms);
+    if (rc <= 0)
+        return false;
+
+    char buf[64];
+    while (recv(fd_, buf, sizeof(buf), 0) > 0) {
+    }
+    return true;
+}
+
+void AlertWakeReceiver::kick()
+{
+    if (fd_ < 0)
+        return;
+    sockaddr_un addr;
+    make_addr(path_, addr);
+    const char byte = 1;
+    sendto(fd_, &byte, 1, MSG_DONTWAIT | MSG_NOSIGNAL,
+           reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+
+// Wake-up signal from the gateway (which creates alerts) to alert_worker,
+// over Unix datagram sockets on the volume both containers mount. Each
+// worker binds its own socket in a shared directory and the gateway signals
+// all of them, so a scaled-out fleet is woken together. The signal carries
+// no data: a worker re-reads pending alerts from SQLite, which stays the
+// source of truth, so a lost or coalesced signal only costs the worker's
+// fallback poll interval.
+
+// ALERT_WAKE_DIR if set ("" disables), else alert_wake.d next to the
+// database file.
+std::string alert_wake_dir(const std::string& db_path);
+
+class AlertWakeSender {
+public:
+    explicit AlertWakeSender(const std::string& dir);
+    ~AlertWakeSender();
+    AlertWakeSender(const AlertWakeSender&) = delete;
+    AlertWakeSender& operator=(const AlertWakeSender&) = delete;
+
+    // Signals every worker's socket in the directory. Never blocks; a busy
+    // receiver is skipped, and the socket of a worker that exited without
+    // removing it is deleted.
+    void notify();
+
+private:
+    std::string dir_;
+    int fd_ = -1;
+};
+
+class AlertWakeReceiver {
+public:
+    // Binds <dir>/<name>.sock (created if missing); name is the worker id,
+    // so restarting a worker takes over its own socket and no other.
+    AlertWakeReceiver(const std::string& dir, const std::string& name);
+    ~AlertWakeReceiver();
+    AlertWakeReceiver(const AlertWakeReceiver&) = delete;
+    AlertWakeReceiver& operator=(const AlertWakeReceiver&) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+
+    // Sleeps until a signal arrives or timeout_ms passes; returns true if
+    // woken. Signals that piled up meanwhile are consumed together.
+    bool wait(int timeout_ms);
+
+    // Ends a wait() early from another thread of this process (e.g. a new
+    // retry is due sooner than the wait's timeout).
+    void kick();
+
+private:
+    std::string path_;
+    int fd_ = -1;
+};
@@ -0,0 +1,91 @@
+#include "anomaly_detector.h"
+#include <algorithm>
+#include <cmath>
+
+// Weight of each new reading for an EWMA with this half-life.
+static double ewma_alpha(double half_life) {
+    return 1.0 - std::exp2(-1.0 / std::max(half_life, 1e-3));
+}
+
+AnomalyDetector::AnomalyDetector(const AnomalyOptions& opt)
+    : opt_(opt), alpha_(ewma_alpha(opt.half_life)), fast_alpha_(ewma_alpha(opt.fast_half_life)) {}
+
+bool AnomalyDetector::step(Signal& s, double x, uint32_t n, double min_sd) const {
+    // Scored against the baseline before x joins it.
+    double sd = std::max(std::sqrt(s.noise), min_sd);
+    s.z = (x - s.mean) / sd;
+    s.run = std::abs(s.z) > opt_.z ? static_cast<uint16_t>(std::min<int>(s.run + 1, UINT16_MAX)) : 0;
+
+    double lim = opt_.z * sd;
+    double xc = std::clamp(x, s.mean - lim, s.mean + lim);
+    double step = std::clamp(x - s.last, -lim, lim);
+    s.last = x;
+
+    // Equal weights until the EWMA's own weight is the larger.
+    double a = std::max(alpha_, 1.0 / n);
+    double fa = std::max(fast_alpha_, 1.0 / n);
+
+    s.fast += fa * (xc - s.fast);
+    double drift = (s.fast - s.mean) / sd;
+
+    // Incremental exponentially weighted mean and variance.
+    double diff = xc - s.mean;
+    double incr = a * diff;
+    s.mean += incr;
+    s.var = (1 - a) * (s.var + diff * incr);
+    s.noise += a * (step * step / 2 - s.noise);
+
+    return n > static_cast<uint32_t>(opt_.warmup) && (s.run >= opt_.persist || std::abs(drift) > opt_.drift);
+}
+
+void AnomalyDetector::update(const std::vector<ReadingSample>& batch, std::vector<uint8_t>& anomalous) {
+    anomalous.assign(batch.size(), 0);
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    undo_.clear();
+    added_.clear();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const ReadingSample& r = batch[i];
+        if (!std::isfinite(r.temp) || !std::isfinite(r.vib)) continue;   // would poison the averages
+        auto slot = state_.try_emplace(r.sensor_uuid);
+        if (slot.second) added_.push_back(r.sensor_uuid);
+        State& st = slot.first->second;
+        undo_.emplace_back(&st, st);
+        if (st.count == 0) {
+            st.temp.fast = st.temp.mean = st.temp.last = r.temp;
+            st.vib.fast = st.vib.mean = st.vib.last = r.vib;
+            st.count = 1;
+            continue;
+        }
+        if (st.count < UINT32_MAX) st.count++;
+        bool t = step(st.temp, r.temp, st.count, opt_.temp_min_sd);
+        bool v = step(st.vib, r.vib, st.count, opt_.vib_min_sd);
+        anomalous[i] = t || v;
+    }
+}
+
+bool AnomalyDetector::stats(const std::string& uuid, Signal& temp, Signal& vib, uint32_t& count) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = state_.find(uuid);
+    if (it == state_.end()) return false;
+    temp = it->second.temp;
+    vib = it->second.vib;
+    count = it->second.count;
+    return true;
+}
+
+void AnomalyDetector::rollback() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto it = undo_.rbegin(); it != undo_.rend(); ++it)
+        *it->first = it->second;
+    // Sensors first seen in that batch go again.
+    for (const auto& uuid : added_)
+        state_.erase(uuid);
+    undo_.clear();
+    added_.clear();
+}
+
+size_t AnomalyDetector::sensors() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return state_.size();
+}
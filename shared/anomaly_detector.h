@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "models.h"
+
+// Tuning of AnomalyDetector. Half-lives are in readings of one sensor.
+struct AnomalyOptions {
+    double half_life = 100;      // baseline: EWMA mean and variance
+    double fast_half_life = 5;   // short EWMA compared against the baseline
+    double z = 4;                // a reading this many sd from the baseline...
+    int persist = 3;             // ...this many times in a row is an anomaly
+    double drift = 3;            // short EWMA this many sd off the baseline
+    int warmup = 30;             // readings before a sensor can be anomalous
+    double temp_min_sd = 0.5;    // sd floors, so a flat signal doesn't turn
+    double vib_min_sd = 0.05;    // every small wobble into a huge z-score
+};
+
+// Streaming statistics per sensor, for temperature and vibration: a
+// baseline (exponentially weighted mean and variance), a short EWMA, and
+// the z-score of each reading against the baseline. O(1) memory per sensor
+// and O(1) work per reading.
+//
+// A reading is anomalous when, on either signal, its z-score has been
+// beyond `z` for `persist` readings in a row (a step change or a run of
+// outliers, but not one spike), or the short EWMA has drifted `drift` sd
+// away from the baseline (a slow drift the baseline only partly follows).
+//
+// The sd scores are taken against is the noise level, estimated from the
+// differences of successive readings: a drift or step inflates the
+// variance around the lagging baseline, but barely moves this. Readings
+// enter the averages clipped to `z` sd, so a single spike shifts nothing
+// far, and the first 1/alpha readings are weighted equally so a young
+// baseline isn't biased towards its first value.
+class AnomalyDetector {
+public:
+    explicit AnomalyDetector(const AnomalyOptions& opt = AnomalyOptions());
+
+    // anomalous[i] = 1 if batch[i] is anomalous. Readings of a sensor must
+    // be in time order; state carries over between batches. Thread-safe.
+    void update(const std::vector<ReadingSample>& batch, std::vector<uint8_t>& anomalous);
+    // Puts back the state the last update() changed, when its batch was not
+    // stored after all. Call it before the next update() (see
+    // AlertRules::rollback).
+    void rollback();
+
+    struct Signal {
+        double fast = 0;    // short EWMA
+        double mean = 0;    // baseline
+        double var = 0;     // around the baseline
+        double noise = 0;   // variance of the noise (successive differences / 2)
+        double last = 0;    // previous reading
+        double z = 0;       // of the last reading
+        uint16_t run = 0;   // consecutive readings beyond opt.z
+    };
+    // Copy of a sensor's state; false if it has no readings yet.
+    bool stats(const std::string& uuid, Signal& temp, Signal& vib, uint32_t& count) const;
+
+    size_t sensors() const;
+
+private:
+    struct State {
+        Signal temp, vib;
+        uint32_t count = 0;
+    };
+
+    // Folds the n-th reading x into s; true if s is anomalous after it.
+    bool step(Signal& s, double x, uint32_t n, double min_sd) const;
+
+    AnomalyOptions opt_;
+    double alpha_;       // baseline weight per reading
+    double fast_alpha_;
+
+    mutable std::mutex mtx_;
+    std::unordered_map<std::string, State> state_;
+    // Each reading's sensor state as it was before the last batch (element
+    // pointers survive a rehash), and the sensors that batch added.
+    std::vector<std::pair<State*, State>> undo_;
+    std::vector<std::string> added_;
+};
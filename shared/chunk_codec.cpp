@@ -0,0 +1,250 @@
+#include "chunk_codec.h"
+#include <algorithm>
+#include <cstring>
+
+// =================== BITS ===================
+
+void BitWriter::write(uint64_t bits, int n) {
+    while (n > 0) {
+        if (free_ == 0) {
+            buf_.push_back(0);
+            free_ = 8;
+        }
+        int take = std::min(n, free_);
+        uint8_t part = static_cast<uint8_t>((bits >> (n - take)) & ((1u << take) - 1));
+        buf_.back() |= static_cast<uint8_t>(part << (free_ - take));
+        free_ -= take;
+        n -= take;
+    }
+}
+
+void BitReader::refill() {
+    while (avail_ <= 56 && p_ < end_) {
+        acc_ = (acc_ << 8) | *p_++;
+        avail_ += 8;
+    }
+}
+
+uint64_t BitReader::read(int n) {
+    if (n > 32) {
+        uint64_t hi = read(n - 32);
+        return (hi << 32) | read(32);
+    }
+    if (avail_ < n) refill();
+    if (avail_ < n) {
+        // Past the end of the stream: pad with zeros.
+        acc_ <<= (n - avail_);
+        avail_ = n;
+    }
+    avail_ -= n;
+    return (acc_ >> avail_) & ((1ULL << n) - 1);
+}
+
+// =================== COLUMN CODECS ===================
+
+// Small signed values in as few bits as possible ('0' for zero).
+static void put_bucketed(BitWriter& w, int64_t v) {
+    if (v == 0) {
+        w.write(0b0, 1);
+    } else if (v >= -64 && v <= 63) {
+        w.write(0b10, 2);
+        w.write(static_cast<uint64_t>(v), 7);
+    } else if (v >= -256 && v <= 255) {
+        w.write(0b110, 3);
+        w.write(static_cast<uint64_t>(v), 9);
+    } else if (v >= -2048 && v <= 2047) {
+        w.write(0b1110, 4);
+        w.write(static_cast<uint64_t>(v), 12);
+    } else {
+        w.write(0b1111, 4);
+        w.write(static_cast<uint64_t>(v), 64);
+    }
+}
+
+static int64_t sign_extend(uint64_t v, int bits) {
+    uint64_t m = 1ULL << (bits - 1);
+    return static_cast<int64_t>((v ^ m) - m);
+}
+
+static int64_t get_bucketed(BitReader& r) {
+    if (!r.read_bit()) return 0;
+    if (!r.read_bit()) return sign_extend(r.read(7), 7);
+    if (!r.read_bit()) return sign_extend(r.read(9), 9);
+    if (!r.read_bit()) return sign_extend(r.read(12), 12);
+    return static_cast<int64_t>(r.read(64));
+}
+
+static uint64_t double_bits(double v) {
+    uint64_t b;
+    std::memcpy(&b, &v, sizeof(b));
+    return b;
+}
+
+static double bits_double(uint64_t b) {
+    double v;
+    std::memcpy(&v, &b, sizeof(v));
+    return v;
+}
+
+void ReadingChunk::put_float(BitWriter& w, FloatState& st, double v) {
+    uint64_t bits = double_bits(v);
+    uint64_t x = bits ^ st.prev;
+    st.prev = bits;
+
+    if (x == 0) {
+        w.write(0b0, 1);
+        return;
+    }
+
+    int lead = std::min(__builtin_clzll(x), 31);
+    int trail = __builtin_ctzll(x);
+
+    if (st.lead >= 0 && lead >= st.lead && trail >= st.trail) {
+        // Fits in the previous window: no need to repeat its shape.
+        w.write(0b10, 2);
+        w.write(x >> st.trail, 64 - st.lead - st.trail);
+        return;
+    }
+
+    int len = 64 - lead - trail;
+    w.write(0b11, 2);
+    w.write(static_cast<uint64_t>(lead), 5);
+    w.write(static_cast<uint64_t>(len & 63), 6);   // 64 stored as 0
+    w.write(x >> trail, len);
+    st.lead = lead;
+    st.trail = trail;
+}
+
+// =================== CHUNK ===================
+
+void ReadingChunk::append(const ReadingRow& r) {
+    if (count_ == 0) {
+        ts_.write(static_cast<uint32_t>(r.ts), 32);
+        temp_.write(double_bits(r.temp), 64);
+        vib_.write(double_bits(r.vib), 64);
+        batt_.write(static_cast<uint32_t>(r.batt), 32);
+        temp_st_.prev = double_bits(r.temp);
+        vib_st_.prev = double_bits(r.vib);
+        min_ts_ = max_ts_ = r.ts;
+    } else {
+        int64_t delta = static_cast<int64_t>(r.ts) - prev_ts_;
+        put_bucketed(ts_, delta - prev_delta_);
+        prev_delta_ = delta;
+        put_float(temp_, temp_st_, r.temp);
+        put_float(vib_, vib_st_, r.vib);
+        put_bucketed(batt_, static_cast<int64_t>(r.batt) - prev_batt_);
+        min_ts_ = std::min(min_ts_, r.ts);
+        max_ts_ = std::max(max_ts_, r.ts);
+    }
+    prev_ts_ = r.ts;
+    prev_batt_ = r.batt;
+    count_++;
+}
+
+static void put_u16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static const uint8_t CHUNK_VERSION = 1;
+static const size_t CHUNK_HEADER = 1 + 2 + 4 * 4;
+
+std::vector<uint8_t> ReadingChunk::serialize() const {
+    const BitWriter* cols[4] = {&ts_, &temp_, &vib_, &batt_};
+    std::vector<uint8_t> out;
+    size_t total = CHUNK_HEADER;
+    for (auto* c : cols) total += c->bytes().size();
+    out.reserve(total);
+
+    out.push_back(CHUNK_VERSION);
+    put_u16(out, static_cast<uint16_t>(count_));
+    for (auto* c : cols) put_u32(out, static_cast<uint32_t>(c->bytes().size()));
+    for (auto* c : cols) out.insert(out.end(), c->bytes().begin(), c->bytes().end());
+    return out;
+}
+
+static void get_floats(BitReader& r, size_t count, ReadingRow* rows, double ReadingRow::*field) {
+    uint64_t prev = r.read(64);
+    rows[0].*field = bits_double(prev);
+    int lead = 0, trail = 0;
+    for (size_t i = 1; i < count; ++i) {
+        if (r.read_bit()) {
+            if (r.read_bit()) {
+                lead = static_cast<int>(r.read(5));
+                int len = static_cast<int>(r.read(6));
+                if (len == 0) len = 64;
+                trail = 64 - lead - len;
+            }
+            prev ^= r.read(64 - lead - trail) << trail;
+        }
+        rows[i].*field = bits_double(prev);
+    }
+}
+
+bool ReadingChunk::decode(const uint8_t* data, size_t n, std::vector<ReadingRow>& out) {
+    if (n < CHUNK_HEADER || data[0] != CHUNK_VERSION) return false;
+
+    size_t count = size_t(data[1]) | size_t(data[2]) << 8;
+    uint32_t len[4];
+    size_t total = CHUNK_HEADER;
+    for (int i = 0; i < 4; ++i) {
+        len[i] = get_u32(data + 3 + 4 * i);
+        total += len[i];
+    }
+    if (total > n) return false;
+    if (count == 0) return true;
+
+    size_t base = out.size();
+    out.resize(base + count);
+    ReadingRow* rows = out.data() + base;
+
+    const uint8_t* p = data + CHUNK_HEADER;
+    {
+        BitReader r(p, len[0]);
+        int64_t ts = static_cast<int32_t>(r.read(32));
+        int64_t delta = 0;
+        rows[0].ts = static_cast<int>(ts);
+        for (size_t i = 1; i < count; ++i) {
+            delta += get_bucketed(r);
+            ts += delta;
+            rows[i].ts = static_cast<int>(ts);
+        }
+        p += len[0];
+    }
+    {
+        BitReader r(p, len[1]);
+        get_floats(r, count, rows, &ReadingRow::temp);
+        p += len[1];
+    }
+    {
+        BitReader r(p, len[2]);
+        get_floats(r, count, rows, &ReadingRow::vib);
+        p += len[2];
+    }
+    {
+        BitReader r(p, len[3]);
+        int64_t batt = static_cast<int32_t>(r.read(32));
+        rows[0].batt = static_cast<int>(batt);
+        for (size_t i = 1; i < count; ++i) {
+            batt += get_bucketed(r);
+            rows[i].batt = static_cast<int>(batt);
+        }
+    }
+    return true;
+}
+
+bool ReadingChunk::load(const uint8_t* data, size_t n, ReadingChunk& chunk) {
+    std::vector<ReadingRow> rows;
+    if (!decode(data, n, rows)) return false;
+    chunk = ReadingChunk();
+    for (const auto& r : rows) chunk.append(r);
+    return true;
+}
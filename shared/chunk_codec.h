@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "models.h"
+
+// Gorilla-style encoding for one sensor's readings, stored column by
+// column (ts / temperature / vibration / battery each in their own bit
+// stream) so a chunk can be appended to and decoded sequentially.
+//
+//   ts          delta-of-delta, bucketed ('0' when the cadence is steady)
+//   temp, vib   XOR with the previous double, leading/trailing-zero window
+//   battery     delta, same buckets as ts
+//
+// Blob layout: u8 version | u16 count | 4 x u32 stream bytes | streams...
+
+class BitWriter {
+public:
+    void write(uint64_t bits, int n);   // n <= 64, MSB first
+    void write_bit(bool b) { write(b ? 1 : 0, 1); }
+    const std::vector<uint8_t>& bytes() const { return buf_; }
+
+private:
+    std::vector<uint8_t> buf_;
+    int free_ = 0;   // unused low bits in buf_.back()
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t n) : p_(data), end_(data + n) {}
+    uint64_t read(int n);   // n <= 64; zero bits past the end
+    bool read_bit() { return read(1) != 0; }
+
+private:
+    void refill();
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+    uint64_t acc_ = 0;   // pending bits, right aligned
+    int avail_ = 0;
+};
+
+class ReadingChunk {
+public:
+    static const size_t MAX_ROWS = 120;
+
+    void append(const ReadingRow& r);
+    size_t count() const { return count_; }
+    bool full() const { return count_ >= MAX_ROWS; }
+    int min_ts() const { return min_ts_; }
+    int max_ts() const { return max_ts_; }
+
+    std::vector<uint8_t> serialize() const;
+
+    // Appends the chunk's rows to `out` in insertion (oldest-first) order.
+    static bool decode(const uint8_t* data, size_t n, std::vector<ReadingRow>& out);
+    // Rebuilds an appendable chunk from a serialized one.
+    static bool load(const uint8_t* data, size_t n, ReadingChunk& chunk);
+
+private:
+    struct FloatState {
+        uint64_t prev = 0;
+        int lead = -1;    // window of the last '11' block, -1 = none yet
+        int trail = 0;
+    };
+
+    static void put_float(BitWriter& w, FloatState& st, double v);
+
+    BitWriter ts_, temp_, vib_, batt_;
+    size_t count_ = 0;
+    int min_ts_ = 0;
+    int max_ts_ = 0;
+
+    int64_t prev_ts_ = 0;
+    int64_t prev_delta_ = 0;
+    int64_t prev_batt_ = 0;
+    FloatState temp_st_, vib_st_;
+};
@@ -1,43 +1,103 @@
 #include "db.h"
 #include "log.h"
+#include "migrations.h"
+#include "metrics.h"
 #include <ctime>
 #include <cstdlib>
+#include <climits>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <string_view>
+#include <unordered_map>
 
 // =================== CORE ===================
 
-Database::Database(const std::string& filename)
+static sqlite3* open_connection(const std::string& filename)
 {
-    if (sqlite3_open(filename.c_str(), &db_) != SQLITE_OK)
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(filename.c_str(), &db,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
     {
         Logger::instance().error("Failed to open DB: " + filename);
-        db_ = nullptr;
-        return;
+        sqlite3_close(db);
+        return nullptr;
     }
+    sqlite3_busy_timeout(db, 5000);
+    return db;
+}
+
+Database::Database(const std::string& filename, int readers)
+    : filename_(filename)
+{
+    writer_.db = open_connection(filename);
+    if (!writer_.db)
+        return;
+    writer_.stmts = std::make_unique<StatementCache>(writer_.db);
+
+    // WAL: readers see the last committed snapshot and never wait on the
+    // writer's BEGIN/COMMIT (DELETE mode locked the whole file instead).
+    exec("PRAGMA journal_mode=WAL;");
 
-    exec("PRAGMA journal_mode=DELETE;");
-    sqlite3_busy_timeout(db_, 5000);
+    // Schema is versioned and always brought up to date; DB_INIT=1 only
+    // seeds the default admin.
+    migrate();
 
-    // Only initialize schema + admin if DB_INIT=1
     const char* init_env = std::getenv("DB_INIT");
     bool do_init = (init_env && std::string(init_env) == "1");
 
     if (do_init)
     {
-        init_schema();
         seed_default_admin();
     }
+
+    const char* engine_env = std::getenv("DB_READINGS_ENGINE");
+    readings_ = make_readings_store(engine_env ? engine_env : "");
+
+    for (int i = 0; i < readers; ++i)
+    {
+        auto conn = std::make_unique<Conn>();
+        conn->db = open_connection(filename);
+        if (!conn->db)
+            break;
+        sqlite3_exec(conn->db, "PRAGMA query_only=1;", nullptr, nullptr, nullptr);
+        conn->stmts = std::make_unique<StatementCache>(conn->db);
+        idle_readers_.push_back(conn.get());
+        readers_.push_back(std::move(conn));
+    }
+    if (!readers_.empty())
+    {
+        Logger::instance().info("DB pool: 1 writer + " + std::to_string(readers_.size()) + " readers (WAL)");
+    }
+
+    verify_query_plans();
 }
 
 Database::~Database()
 {
-    if (db_)
-        sqlite3_close(db_);
+    // Cached statements must be finalized before the connection closes.
+    for (auto& r : readers_)
+    {
+        r->stmts.reset();
+        sqlite3_close(r->db);
+    }
+    watch_.stmts.reset();
+    if (watch_.db)
+        sqlite3_close(watch_.db);
+    writer_.stmts.reset();
+    if (writer_.db)
+        sqlite3_close(writer_.db);
 }
 
 bool Database::exec(const std::string& q)
 {
+    auto c = writer();
+    c.name("exec");
+    if (!c.db())
+        return false;
+
     char* err = nullptr;
-    int rc = sqlite3_exec(db_, q.c_str(), nullptr, nullptr, &err);
+    int rc = sqlite3_exec(c.db(), q.c_str(), nullptr, nullptr, &err);
     if (rc != SQLITE_OK)
     {
         std::string msg = err ? std::string(err) : "unknown error";
@@ -48,59 +108,281 @@ bool Database::exec(const std::string& q)
     return true;
 }
 
+// Hot queries, shared with verify_query_plans() so the plan check always
+// looks at the SQL that actually runs.
+// List pages are keyset seeks on the key the page is ordered by, so a
+// page costs the same however deep into the table it starts.
+static const char* Q_SENSORS_FOR_USER =
+    "SELECT uuid,user,commissioned,status,alert,adv_interval,config_time "
+    "FROM sensors WHERE user=?1 AND uuid>?2 ORDER BY uuid LIMIT ?3";
+static const char* Q_SENSORS_ALL =
+    "SELECT uuid,user,commissioned,status,alert,adv_interval,config_time "
+    "FROM sensors WHERE uuid>?1 ORDER BY uuid LIMIT ?2";
+static const char* Q_USERS =
+    "SELECT username,role,approved FROM users WHERE username>?1 ORDER BY username LIMIT ?2";
+// Ids grow with created_at (replayed dead letters keep theirs), so this is
+// still newest first.
+static const char* Q_ALERTS =
+    "SELECT id,sensor_uuid,temperature,vibration,attempts,created_at "
+    "FROM alerts WHERE id<?1 ORDER BY id DESC LIMIT ?2;";
+// Claimable at ?1 (now): due, not leased by a live worker, and none of a
+// sensor's while an earlier one of it is backing off or leased, so retries
+// and concurrent workers keep per-sensor order.
+#define ALERTS_CLAIMABLE \
+    "FROM alerts a WHERE done=0 AND next_attempt_at <= ?1 AND lease_until <= ?1 " \
+    "AND NOT EXISTS (SELECT 1 FROM alerts b WHERE b.done=0 AND b.sensor_uuid=a.sensor_uuid " \
+    "                AND b.id < a.id AND (b.next_attempt_at > ?1 OR b.lease_until > ?1)) "
+#define ALERT_COLS \
+    "id,sensor_uuid,temperature,vibration,attempts,created_at," \
+    "count,coalesce(peak_temp,temperature),coalesce(peak_vib,vibration),coalesce(idem_key,'alert-'||id)"
+static const char* Q_PENDING_ALERTS =
+    "SELECT " ALERT_COLS " " ALERTS_CLAIMABLE "ORDER BY id ASC LIMIT ?2;";
+// One statement, so two workers can never claim the same row.
+static const char* Q_CLAIM_ALERTS =
+    "UPDATE alerts SET claimed_by = ?3, lease_until = ?1 + ?4 "
+    "WHERE id IN (SELECT id " ALERTS_CLAIMABLE "ORDER BY id ASC LIMIT ?2) "
+    "RETURNING " ALERT_COLS ";";
+#undef ALERT_COLS
+#undef ALERTS_CLAIMABLE
+static const char* Q_PURGE_CLOSED_ALERTS =
+    "DELETE FROM alerts WHERE id IN "
+    "(SELECT id FROM alerts WHERE created_at < ?1 AND done=1 LIMIT ?2);";
+
+// =================== CONNECTIONS ===================
+
+void Database::lock_writer()
+{
+    writer_mtx_.lock();
+    if (writer_depth_++ == 0)
+        writer_thread_.store(std::this_thread::get_id());
+}
+
+void Database::unlock_writer()
+{
+    if (--writer_depth_ == 0)
+        writer_thread_.store(std::thread::id());
+    writer_mtx_.unlock();
+}
+
+Database::Lease Database::writer()
+{
+    auto start = std::chrono::steady_clock::now();
+    lock_writer();
+    return Lease(this, &writer_, true, start);
+}
+
+Database::Lease Database::reader()
+{
+    if (readers_.empty() || writer_thread_.load() == std::this_thread::get_id())
+        return writer();
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(readers_mtx_);
+    readers_cv_.wait(lock, [this] { return !idle_readers_.empty(); });
+    Conn* conn = idle_readers_.back();
+    idle_readers_.pop_back();
+    return Lease(this, conn, false, start);
+}
+
+void Database::release_reader(Conn* conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(readers_mtx_);
+        idle_readers_.push_back(conn);
+    }
+    readers_cv_.notify_one();
+}
+
+// Ops are string literals, so each thread keeps its own pointer-keyed map
+// and only takes the registry lock the first time it sees an op.
+static Histogram& db_op_histogram(const char* op)
+{
+    thread_local std::unordered_map<const char*, Histogram*> cache;
+    Histogram*& h = cache[op];
+    if (!h)
+    {
+        h = &Metrics::instance().histogram("db_op_duration_seconds",
+                                           "Database method latency, including the wait for a connection",
+                                           std::string("op=\"") + op + "\"");
+    }
+    return *h;
+}
+
+Database::Lease::~Lease()
+{
+    if (!owner_)
+        return;
+    if (op_)
+    {
+        db_op_histogram(op_).observe(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+    }
+    if (writer_)
+        owner_->unlock_writer();
+    else
+        owner_->release_reader(conn_);
+}
+
+Database::Transaction::Transaction(Database& db) : db_(db)
+{
+    db_.lock_writer();
+    if (db_.writer_.db && sqlite3_get_autocommit(db_.writer_.db))
+        owns_ = db_.exec("BEGIN IMMEDIATE;");
+}
+
+Database::Transaction::~Transaction()
+{
+    if (owns_ && !done_)
+        db_.rollback();
+    db_.unlock_writer();
+}
+
+bool Database::Transaction::commit()
+{
+    if (done_)
+        return true;
+    done_ = true;
+    if (!owns_)
+        return true;
+    if (db_.exec("COMMIT;"))
+        return true;
+    db_.rollback();
+    return false;
+}
+
+Database::WriterLock::WriterLock(Database& db) : db_(db)
+{
+    db_.lock_writer();
+}
+
+Database::WriterLock::~WriterLock()
+{
+    db_.unlock_writer();
+}
+
+void Database::rollback()
+{
+    exec("ROLLBACK;");
+    // Engines may cache rows written by the transaction we just undid.
+    if (readings_)
+        readings_->discard_uncommitted();
+}
+
+StatementCache::Handle Database::prepare(Lease& c, const char* sql, const char* what)
+{
+    if (!c.conn()->stmts)
+        return StatementCache::Handle();
+
+    c.name(what);
+    StatementCache::Handle stmt = c.conn()->stmts->acquire(sql);
+    if (!stmt) {
+        Logger::instance().error(std::string("SQL ERR on prepare for ") + what + ": " + sqlite3_errmsg(c.db()));
+        static Counter& errors = Metrics::instance().counter("db_prepare_errors_total",
+                                                             "Statements that failed to prepare");
+        errors.inc();
+    }
+    return stmt;
+}
+
+uint64_t Database::stmt_cache_hits() const
+{
+    uint64_t n = writer_.stmts ? writer_.stmts->hits() : 0;
+    for (auto& r : readers_)
+        n += r->stmts->hits();
+    return n;
+}
+
+uint64_t Database::stmt_cache_misses() const
+{
+    uint64_t n = writer_.stmts ? writer_.stmts->misses() : 0;
+    for (auto& r : readers_)
+        n += r->stmts->misses();
+    return n;
+}
+
 // =================== SCHEMA & SEED ===================
 
-void Database::init_schema()
+bool Database::migrate()
 {
-    // USERS
-    exec(
-        "CREATE TABLE IF NOT EXISTS users ("
-        "  username TEXT PRIMARY KEY,"
-        "  password TEXT NOT NULL,"
-        "  role TEXT NOT NULL DEFAULT 'user',"
-        "  approved INTEGER NOT NULL DEFAULT 0,"
-        "  sensor_count INTEGER NOT NULL DEFAULT 0"
-        ");"
-    );
+    // BEGIN IMMEDIATE serializes services starting against the same file;
+    // the version is read inside it, so only the first one applies steps.
+    Transaction tx(*this);
+    auto c = writer();
+    if (!c.db())
+        return false;
 
-    // SENSORS
-    exec(
-        "CREATE TABLE IF NOT EXISTS sensors ("
-        "  uuid TEXT PRIMARY KEY, "
-        "  user TEXT, "
-        "  commissioned INTEGER NOT NULL DEFAULT 0, "
-        "  config_time INTEGER DEFAULT 0, "
-        "  status TEXT, "
-        "  alert INTEGER NOT NULL DEFAULT 0, "
-        "  adv_interval INTEGER DEFAULT 5"
-        ");"
-    );
+    int from = schema_version(c.db());
+    if (!run_migrations(c.db()) || !tx.commit())
+    {
+        Logger::instance().error("DB migration failed at schema v" + std::to_string(schema_version(c.db())));
+        return false;
+    }
+    if (from != latest_schema_version())
+    {
+        Logger::instance().info("DB schema v" + std::to_string(from) + " -> v" + std::to_string(latest_schema_version()));
+    }
+    return true;
+}
 
-    // SENSOR READINGS
-    exec(
-        "CREATE TABLE IF NOT EXISTS sensor_readings ("
-        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  sensor_uuid TEXT NOT NULL,"
-        "  timestamp INTEGER NOT NULL,"
-        "  temperature REAL,"
-        "  vibration REAL,"
-        "  battery INTEGER"
-        ");"
-    );
+bool Database::verify_query_plans()
+{
+    struct Expected { const char* what; const char* sql; const char* index; };
+    std::vector<Expected> checks = {
+        {"get_sensors_for_user", Q_SENSORS_FOR_USER, "idx_sensors_user"},
+        {"get_sensors_for_user", Q_SENSORS_ALL, "sqlite_autoindex_sensors_1"},
+        {"get_users", Q_USERS, "sqlite_autoindex_users_1"},
+        {"get_alerts", Q_ALERTS, "INTEGER PRIMARY KEY"},
+        {"get_pending_alerts", Q_PENDING_ALERTS, "idx_alerts_pending"},
+        {"get_pending_alerts", Q_PENDING_ALERTS, "idx_alerts_pending_sensor"},
+        {"purge_closed_alerts", Q_PURGE_CLOSED_ALERTS, "idx_alerts_closed"},
+    };
+    if (readings_ && std::string(readings_->name()) == "sqlite")
+    {
+        checks.push_back({"get_readings_range", SqliteReadingsStore::RANGE_SQL, "idx_readings_sensor_ts"});
+        checks.push_back({"purge_readings", SqliteReadingsStore::PURGE_SQL, "idx_readings_ts"});
+    }
+    else if (readings_ && std::string(readings_->name()) == "chunked")
+    {
+        checks.push_back({"purge_readings", ChunkedReadingsStore::PURGE_SQL, "idx_reading_chunks_max_ts"});
+    }
 
-    // ALERTS
-    exec(
-        "CREATE TABLE IF NOT EXISTS alerts ("
-        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  sensor_uuid TEXT NOT NULL,"
-        "  temperature REAL,"
-        "  vibration REAL,"
-        "  attempts INTEGER NOT NULL DEFAULT 0,"
-        "  processed INTEGER NOT NULL DEFAULT 0,"
-        "  done INTEGER NOT NULL DEFAULT 0,"
-        "  created_at INTEGER NOT NULL DEFAULT (strftime('%s','now'))"
-        ");"
-    );
+    auto c = writer();
+    if (!c.db())
+        return false;
+
+    bool all_ok = true;
+    for (const auto& e : checks)
+    {
+        std::string q = std::string("EXPLAIN QUERY PLAN ") + e.sql;
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(c.db(), q.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+        {
+            Logger::instance().error(std::string("SQL ERR on prepare for plan of ") + e.what + ": " + sqlite3_errmsg(c.db()));
+            sqlite3_finalize(stmt);
+            all_ok = false;
+            continue;
+        }
+
+        // Every step must be an index search (no SCAN of the table, no
+        // temp B-tree sort) through the index migration 4 created for it.
+        std::string plan;
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            auto detail = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            if (!plan.empty()) plan += "; ";
+            plan += detail ? detail : "";
+        }
+        sqlite3_finalize(stmt);
+
+        bool ok = plan.find(e.index) != std::string::npos &&
+                  plan.find("TEMP B-TREE") == std::string::npos;
+        if (!ok)
+        {
+            Logger::instance().warn(std::string("Query plan for ") + e.what + " does not use " + e.index + ": " + plan);
+            all_ok = false;
+        }
+    }
+    return all_ok;
 }
 
 void Database::seed_default_admin()
@@ -116,57 +398,49 @@ void Database::seed_default_admin()
 
 bool Database::create_user(const std::string& u, const std::string& p, int sensor_count)
 {
+    auto c = writer();
     const char* q = "INSERT INTO users (username,password,role,approved,sensor_count) VALUES (?,?,'user',0,?);";
-    sqlite3_stmt* stmt = nullptr;
-
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for create_user: " + std::string(sqlite3_errmsg(db_)));
+    auto stmt = prepare(c, q, "create_user");
+    if (!stmt)
         return false;
-    }
 
     sqlite3_bind_text(stmt, 1, u.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, p.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 3, sensor_count);
 
     bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
 
     if (ok) {
         // This is the missing piece: actually create the sensors for the user.
         create_user_sensors(u, sensor_count);
     } else {
-        Logger::instance().error("SQL ERR on exec for create_user: " + std::string(sqlite3_errmsg(db_)));
+        Logger::instance().error("SQL ERR on exec for create_user: " + std::string(sqlite3_errmsg(c.db())));
     }
     return ok;
 }
 
 bool Database::approve_user(const std::string& u)
 {
+    auto c = writer();
     const char* q = "UPDATE users SET approved=1, role='user' WHERE username=?;";
-    sqlite3_stmt* stmt = nullptr;
-
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for approve_user: " + std::string(sqlite3_errmsg(db_)));
+    auto stmt = prepare(c, q, "approve_user");
+    if (!stmt)
         return false;
-    }
 
     sqlite3_bind_text(stmt, 1, u.c_str(), -1, SQLITE_STATIC);
 
     bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
     return ok;
 }
 
 bool Database::validate_user(const std::string& u, const std::string& p,
                              bool& approved, std::string& role)
 {
+    auto c = reader();
     const char* q = "SELECT password,approved,role FROM users WHERE username=?;";
-    sqlite3_stmt* stmt = nullptr;
-
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for validate_user: " + std::string(sqlite3_errmsg(db_)));
+    auto stmt = prepare(c, q, "validate_user");
+    if (!stmt)
         return false;
-    }
 
     sqlite3_bind_text(stmt, 1, u.c_str(), -1, SQLITE_STATIC);
 
@@ -181,37 +455,40 @@ bool Database::validate_user(const std::string& u, const std::string& p,
         ok = (pw == p);
     }
 
-    sqlite3_finalize(stmt);
     return ok;
 }
 
 int Database::get_sensor_count(const std::string& u)
 {
-    std::string q = "SELECT sensor_count FROM users WHERE username='" + u + "';";
-    sqlite3_stmt* stmt = nullptr;
-
-    if (sqlite3_prepare_v2(db_, q.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    auto c = reader();
+    const char* q = "SELECT sensor_count FROM users WHERE username=?;";
+    auto stmt = prepare(c, q, "get_sensor_count");
+    if (!stmt)
         return 0;
 
+    sqlite3_bind_text(stmt, 1, u.c_str(), -1, SQLITE_STATIC);
+
     int count = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW)
     {
         count = sqlite3_column_int(stmt, 0);
     }
 
-    sqlite3_finalize(stmt);
     return count;
 }
 
-std::vector<UserRow> Database::get_users()
+std::vector<UserRow> Database::get_users(const std::string& after_username, int max)
 {
+    auto c = reader();
     std::vector<UserRow> out;
-    std::string q = "SELECT username,role,approved FROM users;";
 
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, q.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    auto stmt = prepare(c, Q_USERS, "get_users");
+    if (!stmt)
         return out;
 
+    sqlite3_bind_text(stmt, 1, after_username.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, max);
+
     while (sqlite3_step(stmt) == SQLITE_ROW)
     {
         UserRow u;
@@ -220,33 +497,88 @@ std::vector<UserRow> Database::get_users()
         u.approved = sqlite3_column_int(stmt, 2);
         out.push_back(u);
     }
-    sqlite3_finalize(stmt);
     return out;
 }
 
 // =================== SENSORS ===================
 
 void Database::insert_uncommissioned(const std::string& uuid) {
-    exec("INSERT OR IGNORE INTO sensors (uuid, commissioned, status, alert, adv_interval) "
-         "VALUES ('" + uuid + "',0,'uncommissioned',0,5)");
+    auto c = writer();
+    const char* q =
+        "INSERT OR IGNORE INTO sensors (uuid, commissioned, status, alert, adv_interval) "
+        "VALUES (?,0,'uncommissioned',0,5);";
+    auto stmt = prepare(c, q, "insert_uncommissioned");
+    if (!stmt)
+        return;
+
+    sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for insert_uncommissioned: " + std::string(sqlite3_errmsg(c.db())));
+    }
 }
 
 void Database::set_sensor_commissioned(const std::string& uuid, int config_time) {
-    exec("UPDATE sensors SET commissioned=1, status='commissioned', config_time="
-         + std::to_string(config_time) + " WHERE uuid='" + uuid + "'");
+    auto c = writer();
+    const char* q =
+        "UPDATE sensors SET commissioned=1, status='commissioned', config_time=? "
+        "WHERE uuid=?;";
+    auto stmt = prepare(c, q, "set_sensor_commissioned");
+    if (!stmt)
+        return;
+
+    sqlite3_bind_int(stmt, 1, config_time);
+    sqlite3_bind_text(stmt, 2, uuid.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for set_sensor_commissioned: " + std::string(sqlite3_errmsg(c.db())));
+    }
 }
 
 std::vector<std::string> Database::get_sensors() {
+    auto c = reader();
     std::vector<std::string> out;
-    std::string q = "SELECT uuid FROM sensors";
+    const char* q = "SELECT uuid FROM sensors";
 
-    sqlite3_stmt *stmt;
-    sqlite3_prepare_v2(db_, q.c_str(), -1, &stmt, nullptr);
+    auto stmt = prepare(c, q, "get_sensors");
+    if (!stmt)
+        return out;
 
     while (sqlite3_step(stmt) == SQLITE_ROW) {
         out.push_back((const char*)sqlite3_column_text(stmt, 0));
     }
-    sqlite3_finalize(stmt);
+    return out;
+}
+
+std::vector<SensorRow> Database::get_sensors_after(sqlite3_int64& after_rowid, int max)
+{
+    auto c = reader();
+    std::vector<SensorRow> out;
+    const char* q =
+        "SELECT rowid,uuid,user,commissioned,status,alert,adv_interval,config_time "
+        "FROM sensors WHERE rowid > ? ORDER BY rowid LIMIT ?;";
+
+    auto stmt = prepare(c, q, "get_sensors_after");
+    if (!stmt)
+        return out;
+
+    sqlite3_bind_int64(stmt, 1, after_rowid);
+    sqlite3_bind_int(stmt, 2, max);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        auto text = [&](int i) {
+            auto p = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+            return std::string(p ? p : "");
+        };
+        SensorRow s;
+        after_rowid    = sqlite3_column_int64(stmt, 0);
+        s.uuid         = text(1);
+        s.user         = text(2);
+        s.commissioned = (sqlite3_column_int(stmt, 3) != 0);
+        s.status       = text(4);
+        s.alert        = (sqlite3_column_int(stmt, 5) != 0);
+        s.adv_interval = sqlite3_column_int(stmt, 6);
+        s.config_time  = sqlite3_column_int(stmt, 7);
+        out.push_back(s);
+    }
     return out;
 }
 std::string Database::uuid_v1()
@@ -280,28 +612,25 @@ std::string Database::uuid_v1()
 bool Database::create_user_sensors(const std::string& username, int count)
 {
     const char* q = "INSERT OR IGNORE INTO sensors (uuid, user, commissioned, status, alert, adv_interval, config_time) VALUES (?,?,0,'uncommissioned',0,5,0);";
-    sqlite3_stmt* stmt = nullptr;
-
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for create_user_sensors: " + std::string(sqlite3_errmsg(db_)));
-        return false;
-    }
 
     // Use a transaction for much faster bulk inserts
-    exec("BEGIN TRANSACTION;");
+    Transaction tx(*this);
+    auto c = writer();
+    auto stmt = prepare(c, q, "create_user_sensors");
+    if (!stmt)
+        return false;
 
     for (int i = 1; i <= count; ++i) {
         std::string uuid = uuid_v1();
         sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 2, username.c_str(), -1, SQLITE_STATIC);
         if (sqlite3_step(stmt) != SQLITE_DONE) {
-            Logger::instance().error("SQL ERR on exec for create_user_sensors: " + std::string(sqlite3_errmsg(db_)));
+            Logger::instance().error("SQL ERR on exec for create_user_sensors: " + std::string(sqlite3_errmsg(c.db())));
         }
         sqlite3_reset(stmt); // Reset for the next iteration
     }
 
-    sqlite3_finalize(stmt);
-    exec("COMMIT;");
+    tx.commit();
 
     Logger::instance().info(
         "Created " + std::to_string(count) +
@@ -312,112 +641,171 @@ bool Database::create_user_sensors(const std::string& username, int count)
 // NEW: set commissioned / status / adv_interval in one shot
 bool Database::commission_sensor(const std::string& uuid, int config_time, int adv_interval)
 {
+    auto c = writer();
     const char* q =
         "UPDATE sensors "
         "SET commissioned=1, status='commissioned', alert=0, "
         "adv_interval=?, config_time=? "
         "WHERE uuid=?;";
 
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for commission_sensor: " + std::string(sqlite3_errmsg(db_)));
+    auto stmt = prepare(c, q, "commission_sensor");
+    if (!stmt)
         return false;
-    }
 
     sqlite3_bind_int(stmt, 1, adv_interval);
     sqlite3_bind_int(stmt, 2, config_time);
     sqlite3_bind_text(stmt, 3, uuid.c_str(), -1, SQLITE_STATIC);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        Logger::instance().error("SQL ERR on exec for commission_sensor: " + std::string(sqlite3_errmsg(db_)));
-        sqlite3_finalize(stmt);
+        Logger::instance().error("SQL ERR on exec for commission_sensor: " + std::string(sqlite3_errmsg(c.db())));
         return false;
     }
-    sqlite3_finalize(stmt);
     return true;
 }
 
 bool Database::decommission_sensor(const std::string& uuid)
 {
-    std::string q =
+    auto c = writer();
+    const char* q =
         "UPDATE sensors "
         "SET commissioned=0, status='decommissioned' "
-        "WHERE uuid='" + uuid + "'";
-    return exec(q);
+        "WHERE uuid=?;";
+
+    auto stmt = prepare(c, q, "decommission_sensor");
+    if (!stmt)
+        return false;
+
+    sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for decommission_sensor: " + std::string(sqlite3_errmsg(c.db())));
+        return false;
+    }
+    return true;
 }
 
 bool Database::recommission_sensor(const std::string& uuid, int config_time, int adv_interval)
 {
+    auto c = writer();
     const char* q =
         "UPDATE sensors "
         "SET commissioned=1, status='commissioned', alert=0, "
         "adv_interval=?, config_time=? "
         "WHERE uuid=?;";
 
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for recommission_sensor: " + std::string(sqlite3_errmsg(db_)));
+    auto stmt = prepare(c, q, "recommission_sensor");
+    if (!stmt)
         return false;
-    }
 
     sqlite3_bind_int(stmt, 1, adv_interval);
     sqlite3_bind_int(stmt, 2, config_time);
     sqlite3_bind_text(stmt, 3, uuid.c_str(), -1, SQLITE_STATIC);
 
     if (sqlite3_step(stmt) != SQLITE_DONE) {
-        Logger::instance().error("SQL ERR on exec for recommission_sensor: " + std::string(sqlite3_errmsg(db_)));
-        sqlite3_finalize(stmt);
+        Logger::instance().error("SQL ERR on exec for recommission_sensor: " + std::string(sqlite3_errmsg(c.db())));
         return false;
     }
-    sqlite3_finalize(stmt);
     return true;
 }
 
 void Database::update_adv_interval(const std::string& uuid, int adv_interval)
 {
-    std::string q =
+    auto c = writer();
+    const char* q =
         "UPDATE sensors "
-        "SET adv_interval=" + std::to_string(adv_interval) + " "
-        "WHERE uuid='" + uuid + "'";
-    exec(q);
+        "SET adv_interval=? "
+        "WHERE uuid=?;";
+
+    auto stmt = prepare(c, q, "update_adv_interval");
+    if (!stmt)
+        return;
+
+    sqlite3_bind_int(stmt, 1, adv_interval);
+    sqlite3_bind_text(stmt, 2, uuid.c_str(), -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for update_adv_interval: " + std::string(sqlite3_errmsg(c.db())));
+    }
+}
+
+bool Database::flag_sensor_alerts(const std::vector<std::string>& uuids)
+{
+    Transaction tx(*this);
+    auto c = writer();
+    auto stmt = prepare(c, "UPDATE sensors SET alert=1 WHERE uuid=?;", "flag_sensor_alerts");
+    if (!stmt)
+        return false;
+
+    for (const auto& uuid : uuids) {
+        sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            Logger::instance().error("SQL ERR on exec for flag_sensor_alerts: " + std::string(sqlite3_errmsg(c.db())));
+            return false;
+        }
+        sqlite3_reset(stmt);
+    }
+    return tx.commit();
 }
 
 // NEW: list sensors for a user or all (admin)
-std::vector<SensorRow> Database::get_sensors_for_user(const std::string& username, bool admin)
+std::vector<SensorRow> Database::get_sensors_for_user(const std::string& username, bool admin,
+                                                      const std::string& after_uuid, int max)
 {
     std::vector<SensorRow> out;
-    const char* q;
-    sqlite3_stmt *stmt;
+    scan_sensors_for_user(username, admin, after_uuid, max, [&out](const SensorView& v) {
+        out.push_back(SensorRow{std::string(v.uuid), std::string(v.user), v.commissioned,
+                                std::string(v.status), v.alert, v.adv_interval, v.config_time});
+    });
+    return out;
+}
+
+// NULL (e.g. an unassigned sensor's user) reads as "".
+static std::string_view column_view(sqlite3_stmt* stmt, int col)
+{
+    auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+    return text ? std::string_view(text, sqlite3_column_bytes(stmt, col)) : std::string_view();
+}
+
+bool Database::scan_sensors_for_user(const std::string& username, bool admin, const std::string& after_uuid,
+                                     int max, const std::function<void(const SensorView&)>& fn)
+{
+    auto c = reader();
+    StatementCache::Handle stmt;
 
     if (admin) {
-        q = "SELECT uuid,user,commissioned,status,alert,adv_interval,config_time FROM sensors";
-        if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-            return out;
+        stmt = prepare(c, Q_SENSORS_ALL, "get_sensors_for_user");
+        if (!stmt) {
+            return false;
         }
+        sqlite3_bind_text(stmt, 1, after_uuid.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, max);
     } else {
-        q = "SELECT uuid,user,commissioned,status,alert,adv_interval,config_time "
-            "FROM sensors WHERE user=?";
-        if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-            return out;
+        stmt = prepare(c, Q_SENSORS_FOR_USER, "get_sensors_for_user");
+        if (!stmt) {
+            return false;
         }
         sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, after_uuid.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, max);
     }
 
-
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        SensorRow s;
-        s.uuid         = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        // User can be NULL for unassigned sensors
-        s.user         = sqlite3_column_text(stmt, 1) ? reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)) : "";
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        SensorView s;
+        s.uuid         = column_view(stmt, 0);
+        s.user         = column_view(stmt, 1);
         s.commissioned = (sqlite3_column_int(stmt, 2) != 0);
-        s.status       = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        s.status       = column_view(stmt, 3);
         s.alert        = (sqlite3_column_int(stmt, 4) != 0);
         s.adv_interval = sqlite3_column_int(stmt, 5);
         s.config_time  = sqlite3_column_int(stmt, 6);
-        out.push_back(s);
+        fn(s);
     }
-    sqlite3_finalize(stmt);
-    return out;
+    if (rc != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for get_sensors_for_user: " + std::string(sqlite3_errmsg(c.db())));
+        return false;
+    }
+    return true;
 }
 // =================== READINGS ===================
 
@@ -426,147 +814,972 @@ bool Database::insert_reading(const std::string& uuid,
                               double vib,
                               int batt)
 {
-    const char* q =
-        "INSERT INTO sensor_readings("
-        "sensor_uuid,timestamp,temperature,vibration,battery"
-        ") VALUES (?,?,?,?,?);";
+    return insert_readings({ReadingSample{uuid, temp, vib, batt, static_cast<int>(time(nullptr))}});
+}
 
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for insert_reading: " + std::string(sqlite3_errmsg(db_)));
+bool Database::insert_readings(const std::vector<ReadingSample>& batch)
+{
+    if (batch.empty() || !readings_)
+        return batch.empty();
+
+    // Joins the caller's transaction if there is one (e.g. the simulator tick).
+    Transaction tx(*this);
+    auto c = writer();
+    c.name("insert_readings");
+
+    const std::vector<ReadingSample>* rows = &batch;
+    std::vector<ReadingSample> stamped;
+    const int now = static_cast<int>(time(nullptr));
+    if (std::any_of(batch.begin(), batch.end(), [](const ReadingSample& r) { return r.ts <= 0; })) {
+        stamped = batch;
+        for (auto& r : stamped) {
+            if (r.ts <= 0) r.ts = now;
+        }
+        rows = &stamped;
+    }
+
+    if (!readings_->append(StoreConn{c.db(), c.conn()->stmts.get()}, *rows)) {
+        readings_->discard_uncommitted();
+        return false;
+    }
+    if (!update_rollups(c, *rows))
         return false;
+    return tx.commit();
+}
+
+std::vector<ReadingRow> Database::get_readings(const std::string& uuid, int max)
+{
+    return get_readings_range(uuid, INT_MIN, INT_MAX, max);
+}
+
+std::vector<ReadingRow> Database::get_readings_range(const std::string& uuid, int from, int to, int max)
+{
+    std::vector<ReadingRow> out;
+    if (!readings_)
+        return out;
+
+    auto c = reader();
+    c.name("get_readings_range");
+    if (!readings_->query(StoreConn{c.db(), c.conn()->stmts.get()}, uuid, from, to, max, out)) {
+        Logger::instance().error("SQL ERR on prepare for get_readings: " + std::string(sqlite3_errmsg(c.db())));
     }
+    return out;
+}
 
-    sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 2, static_cast<int>(time(nullptr)));
-    sqlite3_bind_double(stmt, 3, temp);
-    sqlite3_bind_double(stmt, 4, vib);
-    sqlite3_bind_int(stmt, 5, batt);
+// =================== ROLLUPS ===================
 
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        Logger::instance().error("SQL ERR on exec for insert_reading: " + std::string(sqlite3_errmsg(db_)));
-        sqlite3_finalize(stmt);
+// Resolutions maintained on insert; queries merge the coarsest one that
+// divides the requested bucket, so cost tracks buckets, not raw samples.
+static const int ROLLUP_RESOLUTIONS[] = {3600, 60};
+
+bool Database::rollup_supported(int bucket_secs)
+{
+    if (bucket_secs <= 0)
         return false;
+    for (int r : ROLLUP_RESOLUTIONS) {
+        if (bucket_secs % r == 0)
+            return true;
+    }
+    return false;
+}
+
+namespace {
+struct RollupAgg {
+    int count = 0;
+    double tmin = 0, tmax = 0, tsum = 0;
+    double vmin = 0, vmax = 0, vsum = 0;
+    int bmin = 0, bmax = 0;
+    long long bsum = 0;
+
+    void add(const ReadingSample& r)
+    {
+        if (count == 0) {
+            tmin = tmax = r.temp;
+            vmin = vmax = r.vib;
+            bmin = bmax = r.batt;
+        } else {
+            tmin = std::min(tmin, r.temp); tmax = std::max(tmax, r.temp);
+            vmin = std::min(vmin, r.vib);  vmax = std::max(vmax, r.vib);
+            bmin = std::min(bmin, r.batt); bmax = std::max(bmax, r.batt);
+        }
+        tsum += r.temp;
+        vsum += r.vib;
+        bsum += r.batt;
+        count++;
+    }
+};
+}
+
+bool Database::update_rollups(Lease& c, const std::vector<ReadingSample>& rows)
+{
+    const char* q =
+        "INSERT INTO reading_rollups(sensor_uuid,bucket_secs,bucket_ts,count,"
+        "temp_min,temp_max,temp_sum,vib_min,vib_max,vib_sum,batt_min,batt_max,batt_sum) "
+        "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?) "
+        "ON CONFLICT(sensor_uuid,bucket_secs,bucket_ts) DO UPDATE SET "
+        "count=count+excluded.count, "
+        "temp_min=min(temp_min,excluded.temp_min), temp_max=max(temp_max,excluded.temp_max), "
+        "temp_sum=temp_sum+excluded.temp_sum, "
+        "vib_min=min(vib_min,excluded.vib_min), vib_max=max(vib_max,excluded.vib_max), "
+        "vib_sum=vib_sum+excluded.vib_sum, "
+        "batt_min=min(batt_min,excluded.batt_min), batt_max=max(batt_max,excluded.batt_max), "
+        "batt_sum=batt_sum+excluded.batt_sum;";
+
+    // Pre-aggregate so each (sensor, resolution, bucket) is one upsert per batch.
+    using Key = std::tuple<std::string_view, int, int>;
+    std::map<Key, RollupAgg> aggs;
+    for (const auto& r : rows) {
+        for (int res : ROLLUP_RESOLUTIONS) {
+            int bucket = r.ts - ((r.ts % res) + res) % res;
+            aggs[Key(r.sensor_uuid, res, bucket)].add(r);
+        }
+    }
+
+    auto stmt = prepare(c, q, "update_rollups");
+    if (!stmt)
+        return false;
+
+    for (const auto& kv : aggs) {
+        const auto& uuid = std::get<0>(kv.first);
+        const RollupAgg& a = kv.second;
+        sqlite3_bind_text(stmt, 1, uuid.data(), static_cast<int>(uuid.size()), SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 2, std::get<1>(kv.first));
+        sqlite3_bind_int(stmt, 3, std::get<2>(kv.first));
+        sqlite3_bind_int(stmt, 4, a.count);
+        sqlite3_bind_double(stmt, 5, a.tmin);
+        sqlite3_bind_double(stmt, 6, a.tmax);
+        sqlite3_bind_double(stmt, 7, a.tsum);
+        sqlite3_bind_double(stmt, 8, a.vmin);
+        sqlite3_bind_double(stmt, 9, a.vmax);
+        sqlite3_bind_double(stmt, 10, a.vsum);
+        sqlite3_bind_int(stmt, 11, a.bmin);
+        sqlite3_bind_int(stmt, 12, a.bmax);
+        sqlite3_bind_int64(stmt, 13, a.bsum);
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            Logger::instance().error("SQL ERR on exec for update_rollups: " + std::string(sqlite3_errmsg(c.db())));
+            return false;
+        }
+        sqlite3_reset(stmt);
     }
-    sqlite3_finalize(stmt);
     return true;
 }
 
-std::vector<ReadingRow> Database::get_readings(const std::string& uuid, int max)
+std::vector<RollupRow> Database::get_rollups(const std::string& uuid, int from, int to,
+                                             int bucket_secs, int max_buckets)
 {
-    std::vector<ReadingRow> out;
-    std::string q =
-        "SELECT temperature,vibration,battery,timestamp "
-        "FROM sensor_readings WHERE sensor_uuid='" + uuid +
-        "' ORDER BY timestamp DESC LIMIT " + std::to_string(max) + ";";
+    std::vector<RollupRow> out;
+    int res = 0;
+    for (int r : ROLLUP_RESOLUTIONS) {
+        if (bucket_secs > 0 && bucket_secs % r == 0) {
+            res = r;
+            break;
+        }
+    }
+    if (res == 0)
+        return out;
 
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, q.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    const char* q =
+        "SELECT (bucket_ts / ?1) * ?1 AS b, sum(count), "
+        "min(temp_min), max(temp_max), sum(temp_sum), "
+        "min(vib_min), max(vib_max), sum(vib_sum), "
+        "min(batt_min), max(batt_max), sum(batt_sum) "
+        "FROM reading_rollups "
+        "WHERE sensor_uuid=?2 AND bucket_secs=?3 AND bucket_ts BETWEEN ?4 AND ?5 "
+        "GROUP BY b ORDER BY b LIMIT ?6;";
+
+    auto c = reader();
+    auto stmt = prepare(c, q, "get_rollups");
+    if (!stmt)
         return out;
 
+    // Widen `from` to the start of its bucket so the first bucket is whole.
+    long long from_aligned = static_cast<long long>(from) - ((from % bucket_secs) + bucket_secs) % bucket_secs;
+
+    sqlite3_bind_int(stmt, 1, bucket_secs);
+    sqlite3_bind_text(stmt, 2, uuid.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, res);
+    sqlite3_bind_int64(stmt, 4, from_aligned);
+    sqlite3_bind_int(stmt, 5, to);
+    sqlite3_bind_int(stmt, 6, max_buckets);
+
     while (sqlite3_step(stmt) == SQLITE_ROW)
     {
-        ReadingRow r;
-        r.temp = sqlite3_column_double(stmt, 0);
-        r.vib  = sqlite3_column_double(stmt, 1);
-        r.batt = sqlite3_column_int(stmt, 2);
-        r.ts   = sqlite3_column_int(stmt, 3);
+        RollupRow r;
+        r.bucket_ts = sqlite3_column_int(stmt, 0);
+        r.count     = sqlite3_column_int(stmt, 1);
+        double n    = r.count > 0 ? r.count : 1;
+        r.temp_min  = sqlite3_column_double(stmt, 2);
+        r.temp_max  = sqlite3_column_double(stmt, 3);
+        r.temp_avg  = sqlite3_column_double(stmt, 4) / n;
+        r.vib_min   = sqlite3_column_double(stmt, 5);
+        r.vib_max   = sqlite3_column_double(stmt, 6);
+        r.vib_avg   = sqlite3_column_double(stmt, 7) / n;
+        r.batt_min  = sqlite3_column_int(stmt, 8);
+        r.batt_max  = sqlite3_column_int(stmt, 9);
+        r.batt_avg  = sqlite3_column_int64(stmt, 10) / n;
         out.push_back(r);
     }
-    sqlite3_finalize(stmt);
     return out;
 }
 
 // =================== ALERTS ===================
 
-std::vector<AlertRow> Database::get_alerts()
+// Ids as a JSON array, for set-based updates through json_each().
+static std::string json_ids(const std::vector<int>& ids)
 {
-    std::vector<AlertRow> out;
-    const char* q =
-        "SELECT id,sensor_uuid,temperature,vibration,attempts,created_at "
-        "FROM alerts ORDER BY created_at DESC;";
-
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for get_alerts: " + std::string(sqlite3_errmsg(db_)));
-        return out;
+    std::string s = "[";
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        if (i) s += ',';
+        s += std::to_string(ids[i]);
     }
+    return s + "]";
+}
 
-    while (sqlite3_step(stmt) == SQLITE_ROW)
+
+std::vector<AlertRow> Database::get_alerts(int after_id, int max)
+{
+    std::vector<AlertRow> out;
+    scan_alerts(after_id, max, [&out](const AlertView& v)
     {
         AlertRow a;
+        a.id          = v.id;
+        a.sensor_uuid = std::string(v.sensor_uuid);
+        a.temperature = v.temperature;
+        a.vibration   = v.vibration;
+        a.attempts    = v.attempts;
+        a.created_at  = v.created_at;
+        out.push_back(std::move(a));
+    });
+    return out;
+}
+
+bool Database::scan_alerts(int after_id, int max, const std::function<void(const AlertView&)>& fn)
+{
+    auto c = reader();
+    auto stmt = prepare(c, Q_ALERTS, "get_alerts");
+    if (!stmt)
+        return false;
+
+    sqlite3_bind_int(stmt, 1, after_id > 0 ? after_id : INT_MAX);
+    sqlite3_bind_int(stmt, 2, max);
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        AlertView a;
         a.id          = sqlite3_column_int(stmt, 0);
-        a.sensor_uuid = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        a.sensor_uuid = column_view(stmt, 1);
         a.temperature = sqlite3_column_double(stmt, 2);
         a.vibration   = sqlite3_column_double(stmt, 3);
         a.attempts    = sqlite3_column_int(stmt, 4);
         a.created_at  = sqlite3_column_int(stmt, 5);
-        out.push_back(a);
+        fn(a);
     }
-    sqlite3_finalize(stmt);
-    return out;
+    if (rc != SQLITE_DONE)
+    {
+        Logger::instance().error("SQL ERR on exec for get_alerts: " + std::string(sqlite3_errmsg(c.db())));
+        return false;
+    }
+    return true;
 }
 
 bool Database::create_alert(const std::string& uuid, double temp, double vib)
 {
-    const char* q = "INSERT INTO alerts (sensor_uuid, temperature, vibration) VALUES (?, ?, ?);";
-    sqlite3_stmt* stmt = nullptr;
+    return raise_alert(uuid, temp, vib, 0) > 0;
+}
 
-    if (sqlite3_prepare_v2(db_, q, -1, &stmt, nullptr) != SQLITE_OK) {
-        Logger::instance().error("SQL ERR on prepare for create_alert: " + std::string(sqlite3_errmsg(db_)));
-        return false;
+int Database::raise_alert(const std::string& uuid, double temp, double vib, int window_secs)
+{
+    Transaction tx(*this);
+    auto c = writer();
+    const int now = static_cast<int>(time(nullptr));
+
+    if (window_secs > 0)
+    {
+        const char* fold =
+            "UPDATE alerts SET count = count + 1, peak_temp = max(coalesce(peak_temp, temperature), ?2), "
+            "  peak_vib = max(coalesce(peak_vib, vibration), ?3), last_seen = ?4 "
+            "WHERE id = (SELECT id FROM alerts WHERE sensor_uuid = ?1 AND created_at >= ?5 "
+            "            ORDER BY created_at DESC LIMIT 1);";
+        auto stmt = prepare(c, fold, "raise_alert");
+        if (!stmt)
+            return -1;
+
+        sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 2, temp);
+        sqlite3_bind_double(stmt, 3, vib);
+        sqlite3_bind_int(stmt, 4, now);
+        sqlite3_bind_int(stmt, 5, now - window_secs);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            Logger::instance().error("SQL ERR on exec for raise_alert: " + std::string(sqlite3_errmsg(c.db())));
+            return -1;
+        }
+        if (sqlite3_changes(c.db()) > 0)
+            return tx.commit() ? 0 : -1;
     }
 
+    const char* q =
+        "INSERT INTO alerts (sensor_uuid, temperature, vibration, created_at, peak_temp, peak_vib, last_seen, idem_key) "
+        "VALUES (?1, ?2, ?3, ?4, ?2, ?3, ?4, ?5);";
+    auto stmt = prepare(c, q, "create_alert");
+    if (!stmt)
+        return -1;
+
+    std::string key = uuid_v1();
     sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_double(stmt, 2, temp);
     sqlite3_bind_double(stmt, 3, vib);
+    sqlite3_bind_int(stmt, 4, now);
+    sqlite3_bind_text(stmt, 5, key.c_str(), -1, SQLITE_STATIC);
 
     bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
 
     if (!ok) {
-        Logger::instance().error("SQL ERR on exec for create_alert: " + std::string(sqlite3_errmsg(db_)));
+        Logger::instance().error("SQL ERR on exec for create_alert: " + std::string(sqlite3_errmsg(c.db())));
+        return -1;
     }
-    return ok;
+    return tx.commit() ? 1 : -1;
+}
+
+static AlertRow read_pending_alert(sqlite3_stmt* stmt)
+{
+    AlertRow a;
+    a.id          = sqlite3_column_int(stmt, 0);
+    a.sensor_uuid = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    a.temperature = sqlite3_column_double(stmt, 2);
+    a.vibration   = sqlite3_column_double(stmt, 3);
+    a.attempts    = sqlite3_column_int(stmt, 4);
+    a.created_at  = sqlite3_column_int(stmt, 5);
+    a.count       = sqlite3_column_int(stmt, 6);
+    a.peak_temp   = sqlite3_column_double(stmt, 7);
+    a.peak_vib    = sqlite3_column_double(stmt, 8);
+    a.idem_key    = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
+    return a;
 }
 
 std::vector<AlertRow> Database::get_pending_alerts(int max)
 {
+    auto c = reader();
     std::vector<AlertRow> out;
-    std::string q =
-        "SELECT id,sensor_uuid,temperature,vibration,attempts "
-        "FROM alerts WHERE done=0 ORDER BY id ASC "
-        "LIMIT " + std::to_string(max) + ";";
-
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db_, q.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    auto stmt = prepare(c, Q_PENDING_ALERTS, "get_pending_alerts");
+    if (!stmt)
         return out;
 
+    sqlite3_bind_int(stmt, 1, static_cast<int>(time(nullptr)));
+    sqlite3_bind_int(stmt, 2, max);
+
     while (sqlite3_step(stmt) == SQLITE_ROW)
-    {
-        AlertRow a;
-        a.id          = sqlite3_column_int(stmt, 0);
-        a.sensor_uuid = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        a.temperature = sqlite3_column_double(stmt, 2);
-        a.vibration   = sqlite3_column_double(stmt, 3);
-        a.attempts    = sqlite3_column_int(stmt, 4);
-        out.push_back(a);
+        out.push_back(read_pending_alert(stmt));
+    return out;
+}
+
+std::vector<AlertRow> Database::claim_alerts(const std::string& worker, int max, int lease_secs)
+{
+    auto c = writer();
+    std::vector<AlertRow> out;
+    auto stmt = prepare(c, Q_CLAIM_ALERTS, "claim_alerts");
+    if (!stmt)
+        return out;
+
+    sqlite3_bind_int(stmt, 1, static_cast<int>(time(nullptr)));
+    sqlite3_bind_int(stmt, 2, max);
+    sqlite3_bind_text(stmt, 3, worker.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 4, lease_secs);
+
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+        out.push_back(read_pending_alert(stmt));
+    if (rc != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for claim_alerts: " + std::string(sqlite3_errmsg(c.db())));
+        return {};
     }
-    sqlite3_finalize(stmt);
+    // RETURNING does not follow the subquery's ORDER BY.
+    std::sort(out.begin(), out.end(), [](const AlertRow& a, const AlertRow& b) { return a.id < b.id; });
     return out;
 }
 
+void Database::release_alerts(const std::string& worker, const std::vector<int>& ids)
+{
+    auto c = writer();
+    const char* q =
+        "UPDATE alerts SET lease_until=0, claimed_by=NULL "
+        "WHERE id IN (SELECT value FROM json_each(?1)) AND claimed_by=?2;";
+    auto stmt = prepare(c, q, "release_alerts");
+    if (!stmt)
+        return;
+
+    std::string json = json_ids(ids);
+    sqlite3_bind_text(stmt, 1, json.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, worker.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for release_alerts: " + std::string(sqlite3_errmsg(c.db())));
+    }
+}
+
+int Database::count_pending_alerts()
+{
+    auto c = reader();
+    auto stmt = prepare(c, "SELECT count(*) FROM alerts WHERE done=0;", "count_pending_alerts");
+    if (!stmt)
+        return -1;
+    return sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+}
+
 void Database::mark_alert_processed(int id)
 {
-    exec("UPDATE alerts SET processed=1 WHERE id=" + std::to_string(id) + ";");
+    auto c = writer();
+    auto stmt = prepare(c, "UPDATE alerts SET processed=1 WHERE id=?;", "mark_alert_processed");
+    if (!stmt)
+        return;
+
+    sqlite3_bind_int(stmt, 1, id);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for mark_alert_processed: " + std::string(sqlite3_errmsg(c.db())));
+    }
 }
 
-void Database::mark_alert_failed(int id)
+void Database::mark_alert_failed(int id, int next_attempt_at)
 {
-    exec("UPDATE alerts SET attempts = attempts + 1 WHERE id=" + std::to_string(id) + ";");
+    auto c = writer();
+    auto stmt = prepare(c, "UPDATE alerts SET attempts = attempts + 1, next_attempt_at=?, "
+                           "lease_until=0, claimed_by=NULL WHERE id=?;",
+                        "mark_alert_failed");
+    if (!stmt)
+        return;
+
+    sqlite3_bind_int(stmt, 1, next_attempt_at);
+    sqlite3_bind_int(stmt, 2, id);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for mark_alert_failed: " + std::string(sqlite3_errmsg(c.db())));
+    }
 }
 
 void Database::mark_alert_done(int id)
 {
-    exec("UPDATE alerts SET done=1 WHERE id=" + std::to_string(id) + ";");
+    auto c = writer();
+    auto stmt = prepare(c, "UPDATE alerts SET done=1 WHERE id=?;", "mark_alert_done");
+    if (!stmt)
+        return;
+
+    sqlite3_bind_int(stmt, 1, id);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for mark_alert_done: " + std::string(sqlite3_errmsg(c.db())));
+    }
+}
+
+bool Database::apply_alert_results(const AlertResults& r)
+{
+    Transaction tx(*this);
+    auto c = writer();
+    c.name("apply_alert_results");
+
+    auto run = [&](const char* q, const std::string& json, const char* what) {
+        auto stmt = prepare(c, q, what);
+        if (!stmt)
+            return false;
+        sqlite3_bind_text(stmt, 1, json.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_bind_parameter_count(stmt) >= 3)
+        {
+            sqlite3_bind_text(stmt, 2, r.reason.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, r.last_error.c_str(), -1, SQLITE_STATIC);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            Logger::instance().error(std::string("SQL ERR on exec for ") + what + ": " + sqlite3_errmsg(c.db()));
+            return false;
+        }
+        return true;
+    };
+
+    if (!r.delivered.empty() &&
+        !run("UPDATE alerts SET processed=1, done=1, lease_until=0, claimed_by=NULL "
+             "WHERE id IN (SELECT value FROM json_each(?1));",
+             json_ids(r.delivered), "apply_alert_results(delivered)"))
+        return false;
+
+    if (!r.retry.empty())
+    {
+        std::string json = "[";
+        for (size_t i = 0; i < r.retry.size(); ++i)
+        {
+            if (i) json += ',';
+            json += "[" + std::to_string(r.retry[i].first) + "," + std::to_string(r.retry[i].second) + "]";
+        }
+        json += "]";
+        if (!run("UPDATE alerts SET attempts = attempts + 1, next_attempt_at = r.due, "
+                 "  lease_until=0, claimed_by=NULL "
+                 "FROM (SELECT json_extract(value,'$[0]') AS id, json_extract(value,'$[1]') AS due "
+                 "      FROM json_each(?1)) AS r "
+                 "WHERE alerts.id = r.id;",
+                 json, "apply_alert_results(retry)"))
+            return false;
+    }
+
+    if (!r.dead.empty())
+    {
+        std::string ids = json_ids(r.dead);
+        if (!run("INSERT OR REPLACE INTO alert_dead_letters "
+                 "(id, sensor_uuid, temperature, vibration, attempts, created_at, failed_at, reason, last_error, "
+                 " count, peak_temp, peak_vib, idem_key) "
+                 "SELECT id, sensor_uuid, temperature, vibration, attempts + 1, created_at, strftime('%s','now'), ?2, ?3, "
+                 "       count, peak_temp, peak_vib, coalesce(idem_key, 'alert-' || id) "
+                 "FROM alerts WHERE id IN (SELECT value FROM json_each(?1));",
+                 ids, "apply_alert_results(dead)") ||
+            !run("UPDATE alerts SET attempts = attempts + 1, done=1, lease_until=0, claimed_by=NULL "
+                 "WHERE id IN (SELECT value FROM json_each(?1));",
+                 ids, "apply_alert_results(dead)"))
+            return false;
+    }
+    return tx.commit();
+}
+
+// =================== DEAD LETTERS ===================
+
+// One sensor (?1) or all; created_at in [?2, ?3]; id > ?4; limit ?5.
+// Per sensor, idx_dead_letters_sensor returns rows in id order.
+#define DL_WHERE_ALL    "created_at BETWEEN ?2 AND ?3 AND id > ?4 "
+#define DL_WHERE_SENSOR "sensor_uuid = ?1 AND " DL_WHERE_ALL
+
+static void bind_dead_letter_filter(sqlite3_stmt* stmt, const DeadLetterFilter& f, int max)
+{
+    if (!f.sensor_uuid.empty())
+        sqlite3_bind_text(stmt, 1, f.sensor_uuid.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, f.from);
+    sqlite3_bind_int(stmt, 3, f.to);
+    sqlite3_bind_int(stmt, 4, f.after_id);
+    sqlite3_bind_int(stmt, 5, max);
+}
+
+bool Database::dead_letter_alert(int id, const std::string& reason, const std::string& last_error)
+{
+    Transaction tx(*this);
+    {
+        auto c = writer();
+        const char* q =
+            "INSERT OR REPLACE INTO alert_dead_letters "
+            "(id, sensor_uuid, temperature, vibration, attempts, created_at, failed_at, reason, last_error, "
+            " count, peak_temp, peak_vib, idem_key) "
+            "SELECT id, sensor_uuid, temperature, vibration, attempts, created_at, strftime('%s','now'), ?2, ?3, "
+            "       count, peak_temp, peak_vib, coalesce(idem_key, 'alert-' || id) "
+            "FROM alerts WHERE id=?1;";
+        auto stmt = prepare(c, q, "dead_letter_alert");
+        if (!stmt)
+            return false;
+
+        sqlite3_bind_int(stmt, 1, id);
+        sqlite3_bind_text(stmt, 2, reason.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, last_error.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            Logger::instance().error("SQL ERR on exec for dead_letter_alert: " + std::string(sqlite3_errmsg(c.db())));
+            return false;
+        }
+    }
+    mark_alert_done(id);
+    return tx.commit();
+}
+
+std::vector<DeadLetterRow> Database::get_dead_letters(const DeadLetterFilter& f, int max)
+{
+    auto c = reader();
+    std::vector<DeadLetterRow> out;
+#define DL_COLS "SELECT id,sensor_uuid,temperature,vibration,attempts,created_at,failed_at,reason,last_error," \
+                "count,coalesce(peak_temp,temperature),coalesce(peak_vib,vibration),idem_key "
+    const char* q = f.sensor_uuid.empty()
+        ? DL_COLS "FROM alert_dead_letters WHERE " DL_WHERE_ALL "ORDER BY id LIMIT ?5;"
+        : DL_COLS "FROM alert_dead_letters WHERE " DL_WHERE_SENSOR "ORDER BY id LIMIT ?5;";
+#undef DL_COLS
+    auto stmt = prepare(c, q, "get_dead_letters");
+    if (!stmt)
+        return out;
+
+    bind_dead_letter_filter(stmt, f, max);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        DeadLetterRow d;
+        d.id          = sqlite3_column_int(stmt, 0);
+        d.sensor_uuid = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        d.temperature = sqlite3_column_double(stmt, 2);
+        d.vibration   = sqlite3_column_double(stmt, 3);
+        d.attempts    = sqlite3_column_int(stmt, 4);
+        d.created_at  = sqlite3_column_int(stmt, 5);
+        d.failed_at   = sqlite3_column_int(stmt, 6);
+        auto reason   = sqlite3_column_text(stmt, 7);
+        auto err      = sqlite3_column_text(stmt, 8);
+        d.reason      = reason ? reinterpret_cast<const char*>(reason) : "";
+        d.last_error  = err ? reinterpret_cast<const char*>(err) : "";
+        d.count       = sqlite3_column_int(stmt, 9);
+        d.peak_temp   = sqlite3_column_double(stmt, 10);
+        d.peak_vib    = sqlite3_column_double(stmt, 11);
+        auto key      = sqlite3_column_text(stmt, 12);
+        d.idem_key    = key ? reinterpret_cast<const char*>(key) : "";
+        out.push_back(d);
+    }
+    return out;
+}
+
+int Database::replay_dead_letters(const DeadLetterFilter& f, int max)
+{
+    Transaction tx(*this);
+    auto c = writer();
+    // The idempotency key goes back with the alert: if a delivery did reach
+    // the gateway before it was given up on, the replay is dropped there.
+    // The original id, like created_at: a new one would put an old alert at
+    // the top of the id-ordered /alerts pages.
+#define DL_REPLAY "INSERT OR REPLACE INTO alerts (id, sensor_uuid, temperature, vibration, created_at, " \
+                  "                    count, peak_temp, peak_vib, last_seen, idem_key) " \
+                  "SELECT id, sensor_uuid, temperature, vibration, created_at, " \
+                  "       count, peak_temp, peak_vib, created_at, idem_key FROM alert_dead_letters "
+    const char* ins = f.sensor_uuid.empty()
+        ? DL_REPLAY "WHERE " DL_WHERE_ALL "ORDER BY id LIMIT ?5;"
+        : DL_REPLAY "WHERE " DL_WHERE_SENSOR "ORDER BY id LIMIT ?5;";
+#undef DL_REPLAY
+    const char* del = f.sensor_uuid.empty()
+        ? "DELETE FROM alert_dead_letters WHERE id IN "
+          "(SELECT id FROM alert_dead_letters WHERE " DL_WHERE_ALL "ORDER BY id LIMIT ?5);"
+        : "DELETE FROM alert_dead_letters WHERE id IN "
+          "(SELECT id FROM alert_dead_letters WHERE " DL_WHERE_SENSOR "ORDER BY id LIMIT ?5);";
+
+    int moved = 0;
+    for (const char* q : {ins, del})
+    {
+        auto stmt = prepare(c, q, "replay_dead_letters");
+        if (!stmt)
+            return -1;
+
+        bind_dead_letter_filter(stmt, f, max);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            Logger::instance().error("SQL ERR on exec for replay_dead_letters: " + std::string(sqlite3_errmsg(c.db())));
+            return -1;
+        }
+        moved = sqlite3_changes(c.db());
+    }
+    if (!tx.commit())
+        return -1;
+    return moved;
+}
+
+int Database::accept_alert_notices(const std::vector<AlertNotice>& notices)
+{
+    Transaction tx(*this);
+    std::vector<std::string> fresh;
+    {
+        auto c = writer();
+        const char* q =
+            "INSERT OR IGNORE INTO alert_receipts (idem_key, sensor_uuid, received_at) "
+            "VALUES (?, ?, strftime('%s','now'));";
+        auto stmt = prepare(c, q, "accept_alert_notices");
+        if (!stmt)
+            return -1;
+
+        for (const auto& n : notices)
+        {
+            if (n.idem_key.empty())
+            {
+                fresh.push_back(n.sensor_uuid);
+                continue;
+            }
+            sqlite3_bind_text(stmt, 1, n.idem_key.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, n.sensor_uuid.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                Logger::instance().error("SQL ERR on exec for accept_alert_notices: " + std::string(sqlite3_errmsg(c.db())));
+                return -1;
+            }
+            if (sqlite3_changes(c.db()) > 0)
+                fresh.push_back(n.sensor_uuid);
+            sqlite3_reset(stmt);
+        }
+    }
+    if (!fresh.empty() && !flag_sensor_alerts(fresh))
+        return -1;
+    if (!tx.commit())
+        return -1;
+    return static_cast<int>(fresh.size());
+}
+
+int Database::count_dead_letters()
+{
+    auto c = reader();
+    auto stmt = prepare(c, "SELECT count(*) FROM alert_dead_letters;", "count_dead_letters");
+    if (!stmt)
+        return -1;
+    return sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+}
+
+#undef DL_WHERE_SENSOR
+#undef DL_WHERE_ALL
+
+// =================== ALERT RULES ===================
+
+std::vector<AlertRuleRow> Database::get_alert_rules()
+{
+    auto c = reader();
+    std::vector<AlertRuleRow> out;
+    auto stmt = prepare(c,
+        "SELECT id, scope, target, temp_max, vib_max, batt_min, match, "
+        "       temp_hyst, vib_hyst, batt_hyst, enabled "
+        "FROM alert_rules ORDER BY id;", "get_alert_rules");
+    if (!stmt)
+        return out;
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        AlertRuleRow r;
+        r.id     = sqlite3_column_int(stmt, 0);
+        r.scope  = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        r.target = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) r.temp_max = sqlite3_column_double(stmt, 3);
+        if (sqlite3_column_type(stmt, 4) != SQLITE_NULL) r.vib_max = sqlite3_column_double(stmt, 4);
+        if (sqlite3_column_type(stmt, 5) != SQLITE_NULL) r.batt_min = sqlite3_column_int(stmt, 5);
+        r.match_all = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6))) == "all";
+        r.temp_hyst = sqlite3_column_double(stmt, 7);
+        r.vib_hyst  = sqlite3_column_double(stmt, 8);
+        r.batt_hyst = sqlite3_column_int(stmt, 9);
+        r.enabled   = sqlite3_column_int(stmt, 10) != 0;
+        out.push_back(r);
+    }
+    return out;
+}
+
+bool Database::upsert_alert_rule(AlertRuleRow& r)
+{
+    auto c = writer();
+    auto stmt = prepare(c,
+        "INSERT INTO alert_rules (scope, target, temp_max, vib_max, batt_min, match, "
+        "                         temp_hyst, vib_hyst, batt_hyst, enabled) "
+        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10) "
+        "ON CONFLICT (scope, target) DO UPDATE SET "
+        "  temp_max = excluded.temp_max, vib_max = excluded.vib_max, batt_min = excluded.batt_min, "
+        "  match = excluded.match, temp_hyst = excluded.temp_hyst, vib_hyst = excluded.vib_hyst, "
+        "  batt_hyst = excluded.batt_hyst, enabled = excluded.enabled "
+        "RETURNING id;", "upsert_alert_rule");
+    if (!stmt)
+        return false;
+
+    sqlite3_bind_text(stmt, 1, r.scope.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, r.target.c_str(), -1, SQLITE_STATIC);
+    if (r.temp_max) sqlite3_bind_double(stmt, 3, *r.temp_max);
+    if (r.vib_max)  sqlite3_bind_double(stmt, 4, *r.vib_max);
+    if (r.batt_min) sqlite3_bind_int(stmt, 5, *r.batt_min);
+    sqlite3_bind_text(stmt, 6, r.match_all ? "all" : "any", -1, SQLITE_STATIC);
+    sqlite3_bind_double(stmt, 7, r.temp_hyst);
+    sqlite3_bind_double(stmt, 8, r.vib_hyst);
+    sqlite3_bind_int(stmt, 9, r.batt_hyst);
+    sqlite3_bind_int(stmt, 10, r.enabled ? 1 : 0);
+
+    if (sqlite3_step(stmt) != SQLITE_ROW)
+    {
+        Logger::instance().error("SQL ERR on exec for upsert_alert_rule: " + std::string(sqlite3_errmsg(c.db())));
+        return false;
+    }
+    r.id = sqlite3_column_int(stmt, 0);
+    return true;
+}
+
+bool Database::delete_alert_rule(int id)
+{
+    auto c = writer();
+    auto stmt = prepare(c, "DELETE FROM alert_rules WHERE id = ?;", "delete_alert_rule");
+    if (!stmt)
+        return false;
+
+    sqlite3_bind_int(stmt, 1, id);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+    {
+        Logger::instance().error("SQL ERR on exec for delete_alert_rule: " + std::string(sqlite3_errmsg(c.db())));
+        return false;
+    }
+    return sqlite3_changes(c.db()) > 0;
+}
+
+std::vector<std::pair<std::string, std::string>> Database::get_user_rule_sensors()
+{
+    auto c = reader();
+    std::vector<std::pair<std::string, std::string>> out;
+    // One idx_sensors_user range per user rule.
+    auto stmt = prepare(c,
+        "SELECT s.uuid, s.user FROM alert_rules r JOIN sensors s ON s.user = r.target "
+        "WHERE r.scope = 'user' AND r.enabled = 1;", "get_user_rule_sensors");
+    if (!stmt)
+        return out;
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        out.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)),
+                         reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+    }
+    return out;
+}
+
+// =================== CHANGE TRACKING ===================
+
+int64_t Database::table_version(const char* table)
+{
+    std::lock_guard<std::mutex> lock(watch_mtx_);
+    if (!watch_.db)
+    {
+        watch_.db = open_connection(filename_);
+        if (!watch_.db)
+            return 0;
+        sqlite3_exec(watch_.db, "PRAGMA query_only=1;", nullptr, nullptr, nullptr);
+        watch_.stmts = std::make_unique<StatementCache>(watch_.db);
+    }
+
+    // Only looks at the WAL header: no table is read while nothing commits
+    int64_t data_version = -1;
+    {
+        auto stmt = watch_.stmts->acquire("PRAGMA data_version;");
+        if (stmt && sqlite3_step(stmt) == SQLITE_ROW)
+            data_version = sqlite3_column_int64(stmt, 0);
+    }
+
+    // Read after data_version: a commit in between makes the next call
+    // read again, never keeps an older counter
+    if (data_version < 0 || data_version != watch_data_version_)
+    {
+        auto stmt = watch_.stmts->acquire("SELECT name, version FROM table_versions;");
+        if (!stmt)
+        {
+            Logger::instance().error("SQL ERR on prepare for table_version: " + std::string(sqlite3_errmsg(watch_.db)));
+            return 0;
+        }
+        table_versions_.clear();
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            table_versions_[reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))] =
+                sqlite3_column_int64(stmt, 1);
+        }
+        watch_data_version_ = data_version;
+    }
+
+    auto it = table_versions_.find(table);
+    return it == table_versions_.end() ? 0 : it->second;
+}
+
+// =================== MAINTENANCE ===================
+
+static int64_t pragma_int(sqlite3* db, const char* q)
+{
+    sqlite3_stmt* stmt = nullptr;
+    int64_t v = -1;
+    if (sqlite3_prepare_v2(db, q, -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        v = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return v;
+}
+
+int Database::purge_readings(int cutoff_ts, int max_rows)
+{
+    Transaction tx(*this);
+    auto c = writer();
+    c.name("purge_readings");
+    if (!c.db() || !readings_)
+        return -1;
+
+    int n = readings_->purge(StoreConn{c.db(), c.conn()->stmts.get()}, cutoff_ts, max_rows);
+    if (n < 0 || !tx.commit())
+        return -1;
+    return n;
+}
+
+int Database::purge_rollups(int cutoff_ts, int max_rows)
+{
+    auto c = writer();
+    const char* q =
+        "DELETE FROM reading_rollups WHERE (sensor_uuid,bucket_secs,bucket_ts) IN "
+        "(SELECT sensor_uuid,bucket_secs,bucket_ts FROM reading_rollups "
+        " WHERE bucket_ts < ?1 LIMIT ?2);";
+    auto stmt = prepare(c, q, "purge_rollups");
+    if (!stmt)
+        return -1;
+
+    sqlite3_bind_int(stmt, 1, cutoff_ts);
+    sqlite3_bind_int(stmt, 2, max_rows);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for purge_rollups: " + std::string(sqlite3_errmsg(c.db())));
+        return -1;
+    }
+    return sqlite3_changes(c.db());
+}
+
+int Database::purge_alert_receipts(int cutoff_ts, int max_rows)
+{
+    auto c = writer();
+    const char* q =
+        "DELETE FROM alert_receipts WHERE idem_key IN "
+        "(SELECT idem_key FROM alert_receipts WHERE received_at < ?1 LIMIT ?2);";
+    auto stmt = prepare(c, q, "purge_alert_receipts");
+    if (!stmt)
+        return -1;
+
+    sqlite3_bind_int(stmt, 1, cutoff_ts);
+    sqlite3_bind_int(stmt, 2, max_rows);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for purge_alert_receipts: " + std::string(sqlite3_errmsg(c.db())));
+        return -1;
+    }
+    return sqlite3_changes(c.db());
+}
+
+int Database::purge_closed_alerts(int cutoff_ts, int max_rows)
+{
+    auto c = writer();
+    auto stmt = prepare(c, Q_PURGE_CLOSED_ALERTS, "purge_closed_alerts");
+    if (!stmt)
+        return -1;
+
+    sqlite3_bind_int(stmt, 1, cutoff_ts);
+    sqlite3_bind_int(stmt, 2, max_rows);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        Logger::instance().error("SQL ERR on exec for purge_closed_alerts: " + std::string(sqlite3_errmsg(c.db())));
+        return -1;
+    }
+    return sqlite3_changes(c.db());
+}
+
+bool Database::enable_incremental_vacuum()
+{
+    auto c = writer();
+    if (!c.db())
+        return false;
+
+    const int64_t INCREMENTAL = 2;
+    if (pragma_int(c.db(), "PRAGMA auto_vacuum;") == INCREMENTAL)
+        return true;
+
+    // On an empty file the pragma alone is enough; otherwise the page
+    // layout has to be rebuilt once, which holds the write lock throughout.
+    exec("PRAGMA auto_vacuum=INCREMENTAL;");
+    if (pragma_int(c.db(), "PRAGMA auto_vacuum;") != INCREMENTAL)
+    {
+        Logger::instance().info("Rebuilding DB once to enable incremental vacuum");
+        exec("VACUUM;");
+    }
+    return pragma_int(c.db(), "PRAGMA auto_vacuum;") == INCREMENTAL;
+}
+
+int64_t Database::incremental_vacuum(int max_pages)
+{
+    auto c = writer();
+    c.name("incremental_vacuum");
+    if (!c.db())
+        return -1;
+
+    int64_t before = pragma_int(c.db(), "PRAGMA page_count;");
+    std::string q = "PRAGMA incremental_vacuum(" + std::to_string(max_pages) + ");";
+    if (!exec(q))
+        return -1;
+    int64_t after = pragma_int(c.db(), "PRAGMA page_count;");
+    return (before - after) * pragma_int(c.db(), "PRAGMA page_size;");
+}
+
+int64_t Database::size_bytes()
+{
+    auto c = reader();
+    if (!c.db())
+        return -1;
+    return pragma_int(c.db(), "PRAGMA page_count;") * pragma_int(c.db(), "PRAGMA page_size;");
 }
@@ -5,16 +5,68 @@
 #include <random>
 #include <sstream>
 #include <iomanip>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
 #include <sqlite3.h>
 #include "models.h"
 #include "log.h"
+#include "stmt_cache.h"
+#include "readings_store.h"
 
 class Database
 {
 public:
-    explicit Database(const std::string& filename);
+    // readers == 0: a single connection serves everything.
+    // readers > 0 : one writer connection plus `readers` read-only
+    //               connections; WAL lets reads run alongside a write.
+    explicit Database(const std::string& filename, int readers = 0);
     ~Database();
 
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
+
+    // Holds the writer connection for a multi-statement transaction so
+    // other threads' writes cannot interleave with it. Joins an already
+    // open transaction instead of nesting; rolls back unless committed.
+    class Transaction
+    {
+    public:
+        explicit Transaction(Database& db);
+        ~Transaction();
+        bool commit();
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+    private:
+        Database& db_;
+        bool owns_ = false;
+        bool done_ = false;
+    };
+
+    // Holds the writer connection without opening a transaction: no other
+    // thread of this process can write meanwhile, and this thread's reads go
+    // through the writer, so they see exactly the last commit. For reads
+    // that must line up with writes, e.g. seeding a cache the writers keep
+    // up to date, without taking SQLite's write lock for them.
+    class WriterLock
+    {
+    public:
+        explicit WriterLock(Database& db);
+        ~WriterLock();
+
+        WriterLock(const WriterLock&) = delete;
+        WriterLock& operator=(const WriterLock&) = delete;
+
+    private:
+        Database& db_;
+    };
+
     bool exec(const std::string& q);
     std::string uuid_v1();
 
@@ -24,35 +76,215 @@ public:
     bool validate_user(const std::string& u, const std::string& p,
                        bool& approved, std::string& role);
     int get_sensor_count(const std::string& u);
-    std::vector<UserRow> get_users();
+    // One page of users in username order: at most `max` after
+    // after_username ("" = from the first).
+    std::vector<UserRow> get_users(const std::string& after_username, int max);
 
     // ========== SENSORS ==========
     void insert_uncommissioned(const std::string& uuid);
     void set_sensor_commissioned(const std::string& uuid, int config_time);
     std::vector<std::string> get_sensors(); 
+    // Up to `max` sensors with rowid > after_rowid, in rowid order; advances
+    // after_rowid past them. Rows are never deleted and rowids only grow,
+    // so this picks up every sensor added since the last call.
+    std::vector<SensorRow> get_sensors_after(sqlite3_int64& after_rowid, int max);
     bool create_user_sensors(const std::string& username, int count);
     bool commission_sensor(const std::string& uuid, int config_time, int adv_interval);
     bool decommission_sensor(const std::string& uuid);
     bool recommission_sensor(const std::string& uuid, int config_time, int adv_interval);
     void update_adv_interval(const std::string& uuid, int adv_interval);
-    std::vector<SensorRow> get_sensors_for_user(const std::string& username, bool admin);
+    // Sets alert=1 on each sensor, in one transaction.
+    bool flag_sensor_alerts(const std::vector<std::string>& uuids);
+    // One page in uuid order: at most `max` sensors after after_uuid
+    // ("" = from the first); every sensor when admin, else the user's.
+    std::vector<SensorRow> get_sensors_for_user(const std::string& username, bool admin,
+                                                const std::string& after_uuid, int max);
+    // The same page handed to `fn` row by row off the cursor, without
+    // copying it into SensorRows. False on error.
+    bool scan_sensors_for_user(const std::string& username, bool admin, const std::string& after_uuid,
+                               int max, const std::function<void(const SensorView&)>& fn);
 
 
     // ========== READINGS ==========
     bool insert_reading(const std::string& uuid, double temp, double vib, int batt);
+    // All-or-nothing bulk insert using multi-row VALUES statements
+    // (runs in a Transaction, so it joins one that is already open).
+    bool insert_readings(const std::vector<ReadingSample>& batch);
     std::vector<ReadingRow> get_readings(const std::string& uuid, int max);
+    // Newest first, at most `max` rows with from <= timestamp <= to.
+    std::vector<ReadingRow> get_readings_range(const std::string& uuid, int from, int to, int max);
+    const char* readings_engine() const { return readings_ ? readings_->name() : "none"; }
+
+    // Per-bucket min/max/avg/count from the rollup tables, oldest first.
+    // bucket_secs must be a multiple of a maintained resolution (60s).
+    static bool rollup_supported(int bucket_secs);
+    std::vector<RollupRow> get_rollups(const std::string& uuid, int from, int to,
+                                       int bucket_secs, int max_buckets);
 
     // ========== ALERTS ==========
-    std::vector<AlertRow> get_alerts();
+    // One page, newest first: at most `max` alerts with id < after_id
+    // (0 = from the newest).
+    std::vector<AlertRow> get_alerts(int after_id, int max);
+    // The same page handed to `fn` row by row (see scan_sensors_for_user).
+    bool scan_alerts(int after_id, int max, const std::function<void(const AlertView&)>& fn);
     bool create_alert(const std::string& uuid, double temp, double vib);
+    // A threshold breach: folded into the sensor's latest alert created
+    // within the last window_secs, delivered or not (count, peaks,
+    // last_seen), else a new alert with a fresh idempotency key. A breach
+    // that starts a new alarm passes 0 so it always opens an alert (see
+    // SensorSimulator::ingest). 1 = new alert, 0 = folded, -1 = error.
+    int raise_alert(const std::string& uuid, double temp, double vib, int window_secs);
+    // Alerts due now (next_attempt_at has passed) and not leased by a
+    // worker, oldest first.
     std::vector<AlertRow> get_pending_alerts(int max);
+    // The same selection, leased to `worker` for lease_secs in one UPDATE.
+    // Until the lease runs out no other worker gets these alerts, nor later
+    // alerts of the same sensors; mark_alert_failed and release_alerts
+    // give them back early.
+    std::vector<AlertRow> claim_alerts(const std::string& worker, int max, int lease_secs);
+    // Drops the worker's leases on alerts it claimed but will not send.
+    void release_alerts(const std::string& worker, const std::vector<int>& ids);
+    int count_pending_alerts();
     void mark_alert_processed(int id);
-    void mark_alert_failed(int id);
+    // Counts the attempt; the alert is not due again before next_attempt_at.
+    void mark_alert_failed(int id, int next_attempt_at = 0);
     void mark_alert_done(int id);
+    // A whole delivery round in one short transaction: a few set-based
+    // statements (ids passed as JSON arrays), however many alerts.
+    bool apply_alert_results(const AlertResults& r);
+
+    // ========== DEAD LETTERS ==========
+    // Copies the alert into alert_dead_letters and closes it (joins the
+    // caller's transaction).
+    bool dead_letter_alert(int id, const std::string& reason, const std::string& last_error);
+    // Matching dead letters in id order, at most max.
+    std::vector<DeadLetterRow> get_dead_letters(const DeadLetterFilter& f, int max);
+    // Turns up to max matching dead letters back into pending alerts and
+    // removes them, in one transaction. Each alert keeps its id and
+    // created_at (replacing its closed row if retention has not purged it
+    // yet), so /alerts stays in creation order. Returns how many, -1 on
+    // error.
+    int replay_dead_letters(const DeadLetterFilter& f, int max);
+    int count_dead_letters();
+    // Gateway side of delivery: records each notice's idempotency key and
+    // flags the sensors of the ones not seen before, in one transaction,
+    // so a redelivered alert is acknowledged but not applied twice.
+    // Returns how many were new, -1 on error.
+    int accept_alert_notices(const std::vector<AlertNotice>& notices);
+
+    // ========== ALERT RULES ==========
+    std::vector<AlertRuleRow> get_alert_rules();
+    // Inserts or replaces the rule for (scope, target); sets id. False on
+    // error (e.g. an unknown scope).
+    bool upsert_alert_rule(AlertRuleRow& r);
+    bool delete_alert_rule(int id);
+    // (uuid, user) of every sensor whose user has an enabled user rule.
+    std::vector<std::pair<std::string, std::string>> get_user_rule_sensors();
+
+    // ========== MAINTENANCE ==========
+    // Each call is one short write transaction deleting at most max_rows
+    // rows older than cutoff_ts; returns rows (samples) removed, -1 on error.
+    int purge_readings(int cutoff_ts, int max_rows);
+    int purge_rollups(int cutoff_ts, int max_rows);
+    int purge_closed_alerts(int cutoff_ts, int max_rows);
+    int purge_alert_receipts(int cutoff_ts, int max_rows);
+    // Switches the file to auto_vacuum=INCREMENTAL (one full VACUUM if the
+    // database already has content). Returns false if it stays off.
+    bool enable_incremental_vacuum();
+    // Returns up to max_pages free pages to the OS; bytes released or -1.
+    int64_t incremental_vacuum(int max_pages);
+    int64_t size_bytes();
+
+    // ========== CHANGE TRACKING ==========
+    // Counter of changes to `table` ("alerts", "sensors" or "users") that
+    // its list route shows, bumped by triggers whatever process writes.
+    // Served from memory until some connection commits (PRAGMA
+    // data_version), so a poll of unchanged data reads no table. 0 = unknown.
+    int64_t table_version(const char* table);
+
+    // ========== STATS ==========
+    uint64_t stmt_cache_hits() const;
+    uint64_t stmt_cache_misses() const;
+
+    // EXPLAIN QUERY PLAN on the hot queries; warns about any that is not
+    // answered from its index. Runs once at startup.
+    bool verify_query_plans();
 
 private:
-    sqlite3* db_ = nullptr;
+    struct Conn
+    {
+        sqlite3* db = nullptr;
+        std::unique_ptr<StatementCache> stmts;
+    };
+
+    // Scoped use of one connection: the writer (recursive lock) or a reader
+    // checked out of the pool. Declare it before any statement handle so
+    // statements are reset before the connection is given back.
+    //
+    // The first prepare() names the lease's operation; its lifetime (pool
+    // wait included) is then recorded in db_op_duration_seconds{op=...}.
+    class Lease
+    {
+    public:
+        Lease(Database* owner, Conn* conn, bool writer, std::chrono::steady_clock::time_point start)
+            : owner_(owner), conn_(conn), writer_(writer), start_(start) {}
+        ~Lease();
+        Lease(Lease&& o) noexcept
+            : owner_(o.owner_), conn_(o.conn_), writer_(o.writer_), op_(o.op_), start_(o.start_)
+        {
+            o.owner_ = nullptr;
+            o.op_ = nullptr;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        sqlite3* db() const { return conn_->db; }
+        Conn* conn() const { return conn_; }
+        void name(const char* op) { if (!op_) op_ = op; }
+
+    private:
+        Database* owner_;
+        Conn* conn_;
+        bool writer_;
+        const char* op_ = nullptr;   // string literal from prepare()
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    Conn writer_;
+    std::recursive_mutex writer_mtx_;
+    int writer_depth_ = 0;
+    std::atomic<std::thread::id> writer_thread_{};
+
+    std::unique_ptr<ReadingsStore> readings_;
+
+    std::vector<std::unique_ptr<Conn>> readers_;
+    std::vector<Conn*> idle_readers_;
+    std::mutex readers_mtx_;
+    std::condition_variable readers_cv_;
+
+    // table_version(): a read-only connection of its own (opened on first
+    // use), so its data_version moves with every other connection's commit.
+    std::string filename_;
+    Conn watch_;
+    std::mutex watch_mtx_;
+    int64_t watch_data_version_ = -1;
+    std::unordered_map<std::string, int64_t> table_versions_;
+
+    Lease writer();
+    // A pooled reader, or the writer when the pool is empty or the calling
+    // thread is inside a write (so it sees its own uncommitted rows).
+    Lease reader();
+    void lock_writer();
+    void unlock_writer();
+    void release_reader(Conn* conn);
+    void rollback();
+
+    // Cached statement for `sql`; logs "SQL ERR on prepare for <what>" on failure.
+    StatementCache::Handle prepare(Lease& c, const char* sql, const char* what);
 
-    void init_schema();
+    // Applies pending schema migrations (migrations.h) on the writer.
+    bool migrate();
     void seed_default_admin();
+    // Folds a batch into the per-minute and per-hour rollups (writer held).
+    bool update_rollups(Lease& c, const std::vector<ReadingSample>& rows);
 };
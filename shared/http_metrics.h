@@ -0,0 +1,61 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include "metrics.h"
+#include "log.h"
+#include "../third_party/httplib.h"
+
+// Per-route request counts and latency for an httplib::Server, plus the
+// GET /metrics scrape endpoint.
+//
+// httplib runs the pre-routing handler, the route and the logger on the
+// same worker thread, so the start time lives in a thread_local.
+namespace http_metrics {
+
+inline std::chrono::steady_clock::time_point& request_start() {
+    thread_local std::chrono::steady_clock::time_point t;
+    return t;
+}
+
+inline void record(const httplib::Request& req, const httplib::Response& res) {
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - request_start()).count();
+
+    // Label by route, not raw path: unmatched paths and CORS preflights
+    // would otherwise mint a new series per URL.
+    std::string route;
+    if (req.method == "OPTIONS") route = "*";
+    else if (req.matches.empty()) route = "unmatched";
+    else route = req.path;
+
+    // The registry is only consulted the first time a thread sees a series.
+    std::string labels = "method=\"" + req.method + "\",route=\"" + route + "\"";
+    thread_local std::unordered_map<std::string, Histogram*> latency;
+    Histogram*& h = latency[labels];
+    if (!h) h = &Metrics::instance().histogram("http_request_duration_seconds", "HTTP handler latency", labels);
+    h->observe(secs);
+
+    labels += ",status=\"" + std::to_string(res.status) + "\"";
+    thread_local std::unordered_map<std::string, Counter*> requests;
+    Counter*& c = requests[labels];
+    if (!c) c = &Metrics::instance().counter("http_requests_total", "HTTP requests by status", labels);
+    c->inc();
+}
+
+// Installs timing around every route and serves GET /metrics. Pass the
+// server's own pre-routing handler (if any) so both run.
+inline void install(httplib::Server& svr,
+                    httplib::Server::HandlerWithResponse pre_routing = nullptr) {
+    svr.set_pre_routing_handler([pre_routing](const httplib::Request& req, httplib::Response& res) {
+        request_start() = std::chrono::steady_clock::now();
+        return pre_routing ? pre_routing(req, res) : httplib::Server::HandlerResponse::Unhandled;
+    });
+    svr.set_logger(record);
+    Metrics::instance().counter_fn("log_dropped_lines_total", "Log lines dropped because the async queue was full",
+                                   [] { return static_cast<double>(Logger::instance().dropped()); });
+    svr.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(Metrics::instance().render(), "text/plain; version=0.0.4");
+    });
+}
+
+} // namespace http_metrics
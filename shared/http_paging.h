@@ -0,0 +1,85 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../third_party/httplib.h"
+
+// Keyset pagination and conditional GET for the list routes.
+//
+//   GET /alerts?after_id=<last id of the previous page>&limit=100
+//
+// A page holds at most `limit` rows after the cursor. When more follow,
+// X-Next-After-Id carries the cursor for the next page; on the last page it
+// is absent. Every page carries an ETag built from the table's change
+// counter (Database::table_version), so re-polling an unchanged table gets
+// 304 Not Modified before any query runs.
+namespace http_paging {
+
+const int DEFAULT_LIMIT = 100;
+const int MAX_LIMIT = 1000;
+
+inline int limit(const httplib::Request& req) {
+    if (!req.has_param("limit")) return DEFAULT_LIMIT;
+    return std::min(std::max(std::atoi(req.get_param_value("limit").c_str()), 1), MAX_LIMIT);
+}
+
+inline std::string after_id(const httplib::Request& req) {
+    return req.has_param("after_id") ? req.get_param_value("after_id") : std::string();
+}
+
+// `cursor`: key of the last row on this page, when another page follows.
+inline void set_next(httplib::Response& res, const std::string& cursor) {
+    res.set_header("X-Next-After-Id", cursor);
+}
+
+// Rows are fetched with limit + 1 so the route knows whether a next page
+// exists; drops the extra row and sets X-Next-After-Id to the last kept one.
+template <typename Row, typename Key>
+void trim_page(std::vector<Row>& rows, int limit, httplib::Response& res, Key key) {
+    if (rows.size() <= static_cast<size_t>(limit)) return;
+    rows.resize(limit);
+    set_next(res, key(rows.back()));
+}
+
+// Sets the ETag of this page (the version plus a hash of the path and
+// parameters, so one page's tag never validates another). Returns true,
+// with the response already a 304, when If-None-Match names it. Call before
+// reading the table: a change racing the read then only costs a 200.
+// version 0 (unknown) sends no ETag.
+inline bool not_modified(const httplib::Request& req, httplib::Response& res, int64_t version) {
+    if (version <= 0) return false;
+
+    std::string key = req.path;
+    for (const auto& p : req.params) key += "&" + p.first + "=" + p.second;
+    char etag[64];
+    std::snprintf(etag, sizeof(etag), "\"%lld-%zx\"", static_cast<long long>(version),
+                  std::hash<std::string>()(key));
+
+    // Browsers revalidate on every poll instead of reusing a stale page
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("ETag", etag);
+
+    if (!req.has_header("If-None-Match")) return false;
+    const std::string inm = req.get_header_value("If-None-Match");
+    size_t pos = 0;
+    while (pos < inm.size()) {
+        size_t end = inm.find(',', pos);
+        if (end == std::string::npos) end = inm.size();
+        std::string tag = inm.substr(pos, end - pos);
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.compare(0, 2, "W/") == 0) tag.erase(0, 2);
+        if (tag == "*" || tag == etag) {
+            res.status = 304;
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+} // namespace http_paging
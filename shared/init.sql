@@ -1,34 +1,160 @@
+-- Reference snapshot of schema v15. The services do not load this file:
+-- shared/migrations.cpp creates and upgrades the schema at startup.
+
 CREATE TABLE IF NOT EXISTS users (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    username TEXT UNIQUE,
-    password TEXT,
-    role TEXT DEFAULT 'user',
-    approved INTEGER DEFAULT 0
+    username TEXT PRIMARY KEY,
+    password TEXT NOT NULL,
+    role TEXT NOT NULL DEFAULT 'user',
+    approved INTEGER NOT NULL DEFAULT 0,
+    sensor_count INTEGER NOT NULL DEFAULT 0
 );
 
 CREATE TABLE IF NOT EXISTS sensors (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    uuid TEXT UNIQUE,
-    commissioned INTEGER DEFAULT 0,
-    config_time INTEGER DEFAULT 0
+    uuid TEXT PRIMARY KEY,
+    user TEXT,
+    commissioned INTEGER NOT NULL DEFAULT 0,
+    config_time INTEGER DEFAULT 0,
+    status TEXT,
+    alert INTEGER NOT NULL DEFAULT 0,
+    adv_interval INTEGER DEFAULT 5
 );
 
 CREATE TABLE IF NOT EXISTS sensor_readings (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
-    sensor_uuid TEXT,
-    timestamp INTEGER,
+    sensor_uuid TEXT NOT NULL,
+    timestamp INTEGER NOT NULL,
     temperature REAL,
     vibration REAL,
-    battery INTEGER,
-    fault INTEGER DEFAULT 0
+    battery INTEGER
 );
 
 CREATE TABLE IF NOT EXISTS alerts (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
-    sensor_uuid TEXT,
+    sensor_uuid TEXT NOT NULL,
+    temperature REAL,
+    vibration REAL,
+    attempts INTEGER NOT NULL DEFAULT 0,
+    processed INTEGER NOT NULL DEFAULT 0,
+    done INTEGER NOT NULL DEFAULT 0,
+    created_at INTEGER NOT NULL DEFAULT (strftime('%s','now')),
+    next_attempt_at INTEGER NOT NULL DEFAULT 0,
+    count INTEGER NOT NULL DEFAULT 1,
+    peak_temp REAL,
+    peak_vib REAL,
+    last_seen INTEGER,
+    idem_key TEXT,
+    claimed_by TEXT,
+    lease_until INTEGER NOT NULL DEFAULT 0
+);
+
+CREATE TABLE IF NOT EXISTS alert_dead_letters (
+    id INTEGER PRIMARY KEY,
+    sensor_uuid TEXT NOT NULL,
     temperature REAL,
     vibration REAL,
-    attempts INTEGER DEFAULT 0,
-    processed INTEGER DEFAULT 0,
-    done INTEGER DEFAULT 0
+    attempts INTEGER NOT NULL DEFAULT 0,
+    created_at INTEGER NOT NULL,
+    failed_at INTEGER NOT NULL,
+    reason TEXT NOT NULL,
+    last_error TEXT,
+    count INTEGER NOT NULL DEFAULT 1,
+    peak_temp REAL,
+    peak_vib REAL,
+    idem_key TEXT
+);
+
+CREATE TABLE IF NOT EXISTS alert_receipts (
+    idem_key TEXT PRIMARY KEY,
+    sensor_uuid TEXT NOT NULL,
+    received_at INTEGER NOT NULL
+) WITHOUT ROWID;
+
+CREATE TABLE IF NOT EXISTS alert_rules (
+    id INTEGER PRIMARY KEY,
+    scope TEXT NOT NULL CHECK (scope IN ('default', 'user', 'sensor')),
+    target TEXT NOT NULL DEFAULT '',
+    temp_max REAL,
+    vib_max REAL,
+    batt_min INTEGER,
+    match TEXT NOT NULL DEFAULT 'any' CHECK (match IN ('any', 'all')),
+    temp_hyst REAL NOT NULL DEFAULT 0,
+    vib_hyst REAL NOT NULL DEFAULT 0,
+    batt_hyst INTEGER NOT NULL DEFAULT 0,
+    enabled INTEGER NOT NULL DEFAULT 1,
+    UNIQUE (scope, target)
+);
+INSERT OR IGNORE INTO alert_rules (scope, target, temp_max, vib_max) VALUES ('default', '', 80, 9);
+
+CREATE TABLE IF NOT EXISTS reading_rollups (
+    sensor_uuid TEXT NOT NULL,
+    bucket_secs INTEGER NOT NULL,
+    bucket_ts INTEGER NOT NULL,
+    count INTEGER NOT NULL,
+    temp_min REAL, temp_max REAL, temp_sum REAL,
+    vib_min REAL, vib_max REAL, vib_sum REAL,
+    batt_min INTEGER, batt_max INTEGER, batt_sum INTEGER,
+    PRIMARY KEY (sensor_uuid, bucket_secs, bucket_ts)
+) WITHOUT ROWID;
+
+-- Gorilla-encoded readings (DB_READINGS_ENGINE=chunked)
+CREATE TABLE IF NOT EXISTS reading_chunks (
+    id INTEGER PRIMARY KEY,
+    sensor_uuid TEXT NOT NULL,
+    min_ts INTEGER NOT NULL,
+    max_ts INTEGER NOT NULL,
+    count INTEGER NOT NULL,
+    data BLOB NOT NULL
 );
+
+-- Change counters behind the list routes' ETags
+CREATE TABLE IF NOT EXISTS table_versions (
+    name TEXT PRIMARY KEY,
+    version INTEGER NOT NULL DEFAULT 1
+) WITHOUT ROWID;
+INSERT OR IGNORE INTO table_versions (name) VALUES ('alerts'), ('sensors'), ('users');
+CREATE TRIGGER IF NOT EXISTS alerts_version_ins AFTER INSERT ON alerts BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'alerts';
+END;
+CREATE TRIGGER IF NOT EXISTS alerts_version_upd AFTER UPDATE OF sensor_uuid, temperature, vibration, created_at ON alerts BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'alerts';
+END;
+CREATE TRIGGER IF NOT EXISTS alerts_version_del AFTER DELETE ON alerts BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'alerts';
+END;
+CREATE TRIGGER IF NOT EXISTS sensors_version_ins AFTER INSERT ON sensors BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'sensors';
+END;
+CREATE TRIGGER IF NOT EXISTS sensors_version_upd AFTER UPDATE OF uuid, user, commissioned, status, alert, adv_interval, config_time ON sensors BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'sensors';
+END;
+CREATE TRIGGER IF NOT EXISTS sensors_version_del AFTER DELETE ON sensors BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'sensors';
+END;
+CREATE TRIGGER IF NOT EXISTS users_version_ins AFTER INSERT ON users BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'users';
+END;
+CREATE TRIGGER IF NOT EXISTS users_version_upd AFTER UPDATE OF username, role, approved ON users BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'users';
+END;
+CREATE TRIGGER IF NOT EXISTS users_version_del AFTER DELETE ON users BEGIN
+    UPDATE table_versions SET version = version + 1 WHERE name = 'users';
+END;
+
+CREATE INDEX IF NOT EXISTS idx_readings_sensor_ts
+    ON sensor_readings(sensor_uuid, timestamp, temperature, vibration, battery);
+CREATE INDEX IF NOT EXISTS idx_alerts_pending
+    ON alerts(id, sensor_uuid, next_attempt_at, lease_until) WHERE done=0;
+CREATE INDEX IF NOT EXISTS idx_alerts_pending_sensor
+    ON alerts(sensor_uuid, id, next_attempt_at, lease_until) WHERE done=0;
+CREATE INDEX IF NOT EXISTS idx_alerts_closed ON alerts(created_at) WHERE done=1;
+CREATE INDEX IF NOT EXISTS idx_sensors_user
+    ON sensors(user, uuid, commissioned, status, alert, adv_interval, config_time);
+CREATE INDEX IF NOT EXISTS idx_rollups_bucket_ts ON reading_rollups(bucket_ts);
+CREATE INDEX IF NOT EXISTS idx_readings_ts ON sensor_readings(timestamp);
+CREATE INDEX IF NOT EXISTS idx_dead_letters_sensor ON alert_dead_letters(sensor_uuid, id);
+CREATE INDEX IF NOT EXISTS idx_alerts_sensor_created ON alerts(sensor_uuid, created_at);
+CREATE INDEX IF NOT EXISTS idx_alert_receipts_received ON alert_receipts(received_at);
+CREATE INDEX IF NOT EXISTS idx_reading_chunks_sensor ON reading_chunks(sensor_uuid, max_ts);
+CREATE INDEX IF NOT EXISTS idx_reading_chunks_max_ts ON reading_chunks(max_ts);
+
+PRAGMA user_version = 15;
@@ -0,0 +1,74 @@
+#include "json_writer.h"
+#include <charconv>
+#include <cmath>
+
+void JsonWriter::key(std::string_view k) {
+    separate();
+    put_string(k);
+    out_ += ':';
+    first_ = true;
+}
+
+void JsonWriter::value(std::string_view s) {
+    separate();
+    put_string(s);
+}
+
+void JsonWriter::value(double v) {
+    separate();
+    if (!std::isfinite(v)) {
+        out_ += "null";
+        return;
+    }
+    char buf[32];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    std::string_view digits(buf, r.ptr - buf);
+    out_ += digits;
+    // A whole number still reads back as a double
+    if (digits.find_first_of(".e") == std::string_view::npos) out_ += ".0";
+}
+
+void JsonWriter::value(int64_t v) {
+    separate();
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, r.ptr - buf);
+}
+
+void JsonWriter::value(bool b) {
+    separate();
+    out_ += b ? "true" : "false";
+}
+
+void JsonWriter::null() {
+    separate();
+    out_ += "null";
+}
+
+void JsonWriter::put_string(std::string_view s) {
+    static const char HEX[] = "0123456789abcdef";
+    out_ += '"';
+    // Copies runs that need no escaping in one append
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out_.append(s.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"':  out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\b': out_ += "\\b"; break;
+            case '\f': out_ += "\\f"; break;
+            case '\n': out_ += "\\n"; break;
+            case '\r': out_ += "\\r"; break;
+            case '\t': out_ += "\\t"; break;
+            default: {
+                char u[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf]};
+                out_.append(u, sizeof(u));
+            }
+        }
+    }
+    out_.append(s.data() + run, s.size() - run);
+    out_ += '"';
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Appends JSON text to a caller-owned buffer without building a document:
+// once the buffer has grown to the response size, writing a row allocates
+// nothing. Commas are placed automatically; inside an object every key()
+// must be followed by one value or container (not checked).
+//
+//   std::string buf;
+//   JsonWriter w(buf);
+//   w.begin_array();
+//   w.begin_object();
+//   w.field("id", 7);
+//   w.field("uuid", "SENS_1");
+//   w.end_object();
+//   w.end_array();                         // [{"id":7,"uuid":"SENS_1"}]
+//
+// Parses back to what nlohmann::json::dump() gave: strings are escaped
+// the same way, whole doubles keep their ".0", NaN and infinities become
+// null. Keys stay in the order written (dump() sorts them), and doubles
+// take their shortest round-trip digits (std::to_chars), which are now
+// and then one digit shorter than dump()'s.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    void begin_array()  { open('['); }
+    void end_array()    { close(']'); }
+    void begin_object() { open('{'); }
+    void end_object()   { close('}'); }
+
+    void key(std::string_view k);
+
+    void value(std::string_view s);
+    void value(const char* s) { value(std::string_view(s)); }
+    void value(double v);
+    void value(int64_t v);
+    void value(int v) { value(static_cast<int64_t>(v)); }
+    void value(bool b);
+    void null();
+
+    template <typename T>
+    void field(std::string_view k, const T& v) {
+        key(k);
+        value(v);
+    }
+
+private:
+    void separate() {
+        if (!first_) out_ += ',';
+        first_ = false;
+    }
+    void open(char c) {
+        separate();
+        out_ += c;
+        first_ = true;
+    }
+    void close(char c) {
+        out_ += c;
+        first_ = false;
+    }
+    void put_string(std::string_view s);
+
+    std::string& out_;
+    bool first_ = true;   // next element needs no comma
+};
@@ -1,27 +1,176 @@
 #include "log.h"
 #include <iostream>
 #include <ctime>
+#include <cstdlib>
+#include <chrono>
 
 Logger& Logger::instance() {
     static Logger inst;
     return inst;
 }
 
+static size_t env_size(const char* name, size_t def) {
+    const char* env = std::getenv(name);
+    if (!env || !*env) return def;
+    long v = std::atol(env);
+    return v > 0 ? static_cast<size_t>(v) : def;
+}
+
 Logger::Logger() {
     file_.open("system.log", std::ios::app);
+
+    const char* async_env = std::getenv("LOG_ASYNC");
+    async_ = !(async_env && std::string(async_env) == "0");
+    const char* overflow_env = std::getenv("LOG_OVERFLOW");
+    block_ = overflow_env && std::string(overflow_env) == "block";
+    if (!async_) return;
+
+    size_t cap = 1;
+    while (cap < env_size("LOG_QUEUE", 8192)) cap <<= 1;
+    ring_.reset(new Slot[cap]);
+    for (size_t i = 0; i < cap; ++i) ring_[i].seq.store(i, std::memory_order_relaxed);
+    mask_ = cap - 1;
+
+    writer_ = std::thread(&Logger::writer_loop, this);
 }
 
-void Logger::log(const std::string& level, const std::string& msg) {
-    std::lock_guard<std::mutex> lock(mtx_);
+Logger::~Logger() {
+    if (!writer_.joinable()) return;
+    flush();
+    stop_.store(true);
+    wake();
+    writer_.join();
+}
 
+// "[YYYY-mm-dd HH:MM:SS]" only changes once a second; format it once per thread.
+static const std::string& timestamp() {
+    thread_local std::time_t last = 0;
+    thread_local std::string stamp;
     std::time_t t = std::time(nullptr);
-    char buf[32];
-    strftime(buf, sizeof(buf), "%F %T", localtime(&t));
+    if (t != last) {
+        last = t;
+        std::tm tm{};
+        localtime_r(&t, &tm);
+        char buf[32];
+        strftime(buf, sizeof(buf), "%F %T", &tm);
+        stamp = std::string("[") + buf + "]";
+    }
+    return stamp;
+}
+
+void Logger::log(const char* level, const std::string& msg) {
+    std::string line;
+    line.reserve(msg.size() + 32);
+    line += timestamp();
+    line += '[';
+    line += level;
+    line += "] ";
+    line += msg;
+    line += '\n';
+
+    if (!async_) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        std::cout << line << std::flush;
+        file_ << line << std::flush;
+        return;
+    }
+
+    bool urgent = level[0] == 'E';
+    while (!try_push(line)) {
+        if (!block_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            dropped_total_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // Full and asked to block: let the writer catch up.
+        wake();
+        std::unique_lock<std::mutex> lock(wake_mtx_);
+        done_cv_.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    if (urgent) wake();
+}
 
-    std::string line = std::string("[") + buf + "][" + level + "] " + msg;
+bool Logger::try_push(std::string& line) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = ring_[pos & mask_];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.line = std::move(line);
+                slot.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;   // the reader hasn't freed this slot yet: full
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::wake() {
+    if (idle_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(wake_mtx_);
+        wake_cv_.notify_one();
+    }
+}
+
+void Logger::write_batch(const std::string& batch) {
+    std::cout.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+    std::cout.flush();
+    file_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+    file_.flush();
+}
+
+void Logger::writer_loop() {
+    std::string batch;
+    while (true) {
+        batch.clear();
+        while (true) {
+            Slot& slot = ring_[tail_ & mask_];
+            if (slot.seq.load(std::memory_order_acquire) != tail_ + 1) break;
+            batch += slot.line;
+            slot.line.clear();
+            slot.seq.store(tail_ + mask_ + 1, std::memory_order_release);
+            ++tail_;
+            if (batch.size() >= (1 << 16)) break;
+        }
+
+        uint64_t lost = dropped_.exchange(0, std::memory_order_relaxed);
+        if (lost) {
+            batch += timestamp() + "[WARN] Logger queue full, dropped " + std::to_string(lost) + " lines\n";
+        }
+
+        if (!batch.empty()) {
+            write_batch(batch);
+            written_.store(tail_, std::memory_order_release);
+            std::lock_guard<std::mutex> lock(wake_mtx_);
+            done_cv_.notify_all();
+            continue;
+        }
+
+        if (stop_.load()) return;
+
+        // Ring empty: sleep until woken or a short tick passes, so ordinary
+        // lines are written in batches without producers ever notifying.
+        std::unique_lock<std::mutex> lock(wake_mtx_);
+        idle_.store(true, std::memory_order_release);
+        wake_cv_.wait_for(lock, std::chrono::milliseconds(20));
+        idle_.store(false, std::memory_order_relaxed);
+    }
+}
 
-    std::cout << line << std::endl;
-    file_ << line << std::endl;
+void Logger::flush() {
+    if (!async_) return;
+    size_t target = head_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(wake_mtx_);
+    wake_cv_.notify_one();
+    while (written_.load(std::memory_order_acquire) < target) {
+        done_cv_.wait_for(lock, std::chrono::milliseconds(5));
+        wake_cv_.notify_one();
+    }
 }
 
 void Logger::info(const std::string& msg) { log("INFO", msg); }
@@ -1,18 +1,66 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <fstream>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 
+// Writes "[time][LEVEL] msg" lines to stdout and system.log.
+//
+// Async mode (default, LOG_ASYNC=0 to disable): callers format the line and
+// push it into a bounded lock-free ring (LOG_QUEUE slots, default 8192); a
+// background thread drains it and writes each batch with one write+flush
+// per sink. When the ring is full, LOG_OVERFLOW=drop (default) discards the
+// line and counts it, LOG_OVERFLOW=block waits for space. ERROR lines wake
+// the writer immediately; flush() waits until everything queued is written
+// and runs on exit.
 class Logger {
 public:
     static Logger& instance();
+    ~Logger();
+
     void info(const std::string& msg);
     void warn(const std::string& msg);
     void error(const std::string& msg);
 
+    void flush();
+    uint64_t dropped() const { return dropped_total_.load(std::memory_order_relaxed); }
+
 private:
     Logger();
     std::ofstream file_;
     std::mutex mtx_;
-    void log(const std::string& level, const std::string& msg);
+    void log(const char* level, const std::string& msg);
+
+    // Bounded MPSC ring: a slot is free for position p when seq == p and
+    // holds a line for the reader when seq == p + 1.
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        std::string line;
+    };
+
+    bool try_push(std::string& line);
+    void writer_loop();
+    void write_batch(const std::string& batch);
+    void wake();
+
+    bool async_ = true;
+    bool block_ = false;
+    std::unique_ptr<Slot[]> ring_;
+    size_t mask_ = 0;
+    std::atomic<size_t> head_{0};      // next position to claim (producers)
+    size_t tail_ = 0;                  // next position to read (writer only)
+    std::atomic<size_t> written_{0};   // positions below this are on disk
+    std::atomic<uint64_t> dropped_{0}; // not yet reported
+    std::atomic<uint64_t> dropped_total_{0};
+
+    std::atomic<bool> idle_{false};
+    std::atomic<bool> stop_{false};
+    std::mutex wake_mtx_;
+    std::condition_variable wake_cv_;  // writer waits here when the ring is empty
+    std::condition_variable done_cv_;  // flush() / blocked producers wait here
+    std::thread writer_;
 };
@@ -0,0 +1,199 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+size_t metrics_detail::shard()
+{
+    static std::atomic<size_t> next{0};
+    thread_local size_t idx = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    return idx;
+}
+
+static void atomic_add(std::atomic<double>& a, double d)
+{
+    double cur = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(cur, cur + d, std::memory_order_relaxed)) {
+    }
+}
+
+// =================== COUNTER / GAUGE ===================
+
+uint64_t Counter::value() const
+{
+    uint64_t n = 0;
+    for (const auto& c : cells_)
+        n += c.v.load(std::memory_order_relaxed);
+    return n;
+}
+
+void Gauge::add(double d)
+{
+    atomic_add(v_, d);
+}
+
+// =================== HISTOGRAM ===================
+
+Histogram::Histogram(std::vector<double> bounds) : bounds_(std::move(bounds))
+{
+    std::sort(bounds_.begin(), bounds_.end());
+    for (auto& s : shards_) {
+        s.counts.reset(new std::atomic<uint64_t>[bounds_.size() + 1]);
+        for (size_t i = 0; i <= bounds_.size(); ++i)
+            s.counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double v)
+{
+    size_t i = std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin();
+    Shard& s = shards_[metrics_detail::shard()];
+    s.counts[i].fetch_add(1, std::memory_order_relaxed);
+    atomic_add(s.sum, v);
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+    Snapshot snap;
+    snap.cumulative.assign(bounds_.size() + 1, 0);
+    for (const auto& s : shards_) {
+        for (size_t i = 0; i <= bounds_.size(); ++i)
+            snap.cumulative[i] += s.counts[i].load(std::memory_order_relaxed);
+        snap.sum += s.sum.load(std::memory_order_relaxed);
+    }
+    for (size_t i = 1; i < snap.cumulative.size(); ++i)
+        snap.cumulative[i] += snap.cumulative[i - 1];
+    return snap;
+}
+
+std::vector<double> Histogram::latency_bounds()
+{
+    return {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+            0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+}
+
+// =================== REGISTRY ===================
+
+Metrics& Metrics::instance()
+{
+    static Metrics inst;
+    return inst;
+}
+
+Metrics::Series& Metrics::series(const std::string& name, const std::string& help, Type type,
+                                 const std::string& labels)
+{
+    auto it = families_.find(name);
+    if (it == families_.end())
+        it = families_.emplace(name, Family{help, type, {}}).first;
+    return it->second.series[labels];
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    Series& s = series(name, help, Type::Counter, labels);
+    if (!s.counter)
+        s.counter = std::make_unique<Counter>();
+    return *s.counter;
+}
+
+Gauge& Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    Series& s = series(name, help, Type::Gauge, labels);
+    if (!s.gauge)
+        s.gauge = std::make_unique<Gauge>();
+    return *s.gauge;
+}
+
+Histogram& Metrics::histogram(const std::string& name, const std::string& help, const std::string& labels,
+                              const std::vector<double>& bounds)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    Series& s = series(name, help, Type::Histogram, labels);
+    if (!s.histogram)
+        s.histogram = std::make_unique<Histogram>(bounds);
+    return *s.histogram;
+}
+
+void Metrics::gauge_fn(const std::string& name, const std::string& help, std::function<double()> fn,
+                       const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    series(name, help, Type::Gauge, labels).fn = std::move(fn);
+}
+
+void Metrics::counter_fn(const std::string& name, const std::string& help, std::function<double()> fn,
+                         const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    series(name, help, Type::Counter, labels).fn = std::move(fn);
+}
+
+static std::string num(double v)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.17g", v);
+    return buf;
+}
+
+static std::string with_label(const std::string& labels, const std::string& extra)
+{
+    return "{" + labels + (labels.empty() ? "" : ",") + extra + "}";
+}
+
+std::string Metrics::render() const
+{
+    // Gauge callbacks may query the DB, which records metrics of its own:
+    // evaluate them before taking the registry lock.
+    std::vector<std::pair<const Series*, std::function<double()>>> fns;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (const auto& f : families_) {
+            for (const auto& s : f.second.series) {
+                if (s.second.fn)
+                    fns.emplace_back(&s.second, s.second.fn);
+            }
+        }
+    }
+    std::map<const Series*, double> sampled;
+    for (const auto& fn : fns)
+        sampled[fn.first] = fn.second();
+
+    static const char* TYPES[] = {"counter", "gauge", "histogram"};
+    std::string out;
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto& f : families_) {
+        const std::string& name = f.first;
+        out += "# HELP " + name + " " + f.second.help + "\n";
+        out += "# TYPE " + name + " " + TYPES[static_cast<int>(f.second.type)] + "\n";
+
+        for (const auto& s : f.second.series) {
+            const std::string& labels = s.first;
+            const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+            const Series& m = s.second;
+
+            if (m.counter) {
+                out += name + braces + " " + std::to_string(m.counter->value()) + "\n";
+            } else if (m.gauge) {
+                out += name + braces + " " + num(m.gauge->value()) + "\n";
+            } else if (m.fn) {
+                auto it = sampled.find(&m);
+                if (it != sampled.end())
+                    out += name + braces + " " + num(it->second) + "\n";
+            } else if (m.histogram) {
+                const Histogram& h = *m.histogram;
+                Histogram::Snapshot snap = h.snapshot();
+                for (size_t i = 0; i < h.bounds().size(); ++i) {
+                    out += name + "_bucket" + with_label(labels, "le=\"" + num(h.bounds()[i]) + "\"") +
+                           " " + std::to_string(snap.cumulative[i]) + "\n";
+                }
+                out += name + "_bucket" + with_label(labels, "le=\"+Inf\"") + " " +
+                       std::to_string(snap.cumulative.back()) + "\n";
+                out += name + "_sum" + braces + " " + num(snap.sum) + "\n";
+                out += name + "_count" + braces + " " + std::to_string(snap.cumulative.back()) + "\n";
+            }
+        }
+    }
+    return out;
+}
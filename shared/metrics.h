@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide counters, gauges and fixed-bucket histograms rendered in the
+// Prometheus text format (GET /metrics).
+//
+// Counters and histograms are split into per-thread shards on separate
+// cache lines, so concurrent updates never share a line; the shards are
+// summed when /metrics is scraped. Look a metric up once and keep the
+// reference: registration takes a lock, updating one does not.
+//
+// `labels` is the preformatted Prometheus label set, e.g.
+//   R"(route="/readings",method="GET")"
+
+namespace metrics_detail {
+static const size_t SHARDS = 16;
+size_t shard();   // this thread's shard index
+}
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) {
+        cells_[metrics_detail::shard()].v.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Cell { std::atomic<uint64_t> v{0}; };
+    Cell cells_[metrics_detail::SHARDS];
+};
+
+class Gauge {
+public:
+    void set(double v) { v_.store(v, std::memory_order_relaxed); }
+    void add(double d);
+    double value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> v_{0};
+};
+
+class Histogram {
+public:
+    // Upper bounds in ascending order; +Inf is implicit.
+    explicit Histogram(std::vector<double> bounds);
+    void observe(double v);
+
+    struct Snapshot {
+        std::vector<uint64_t> cumulative;   // per bound, then +Inf
+        double sum = 0;
+    };
+    Snapshot snapshot() const;
+    const std::vector<double>& bounds() const { return bounds_; }
+
+    // Seconds, 100us .. 10s.
+    static std::vector<double> latency_bounds();
+
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<uint64_t>[]> counts;
+        std::atomic<double> sum{0};
+    };
+    std::vector<double> bounds_;
+    Shard shards_[metrics_detail::SHARDS];
+};
+
+// Records the time from construction to destruction into a histogram.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& h) : h_(h), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        h_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class Metrics {
+public:
+    static Metrics& instance();
+
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                         const std::vector<double>& bounds = Histogram::latency_bounds());
+    // A gauge computed when scraped (e.g. a queue length read from the DB).
+    void gauge_fn(const std::string& name, const std::string& help, std::function<double()> fn,
+                  const std::string& labels = "");
+    // A counter read when scraped from a total kept elsewhere; fn must
+    // never go down (e.g. Logger::dropped()).
+    void counter_fn(const std::string& name, const std::string& help, std::function<double()> fn,
+                    const std::string& labels = "");
+
+    std::string render() const;
+
+private:
+    Metrics() = default;
+
+    enum class Type { Counter, Gauge, Histogram };
+    struct Series {
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> fn;
+    };
+    struct Family {
+        std::string help;
+        Type type;
+        std::map<std::string, Series> series;   // by label set
+    };
+
+    Series& series(const std::string& name, const std::string& help, Type type, const std::string& labels);
+
+    mutable std::mutex mtx_;
+    std::map<std::string, Family> families_;
+};
@@ -0,0 +1,386 @@
+#include "migrations.h"
+#include "log.h"
+#include <string>
+
+static bool run_sql(sqlite3* db, const char* sql)
+{
+    char* err = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err) != SQLITE_OK) {
+        Logger::instance().error("SQL ERR in migration: " + std::string(err ? err : "unknown error"));
+        sqlite3_free(err);
+        return false;
+    }
+    return true;
+}
+
+static bool has_column(sqlite3* db, const char* table, const char* column)
+{
+    std::string q = std::string("PRAGMA table_info(") + table + ");";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(db, q.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+        return false;
+
+    bool found = false;
+    while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+        auto name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        found = name && std::string(name) == column;
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+static bool add_column(sqlite3* db, const char* table, const char* column, const char* decl)
+{
+    if (has_column(db, table, column))
+        return true;
+    std::string q = std::string("ALTER TABLE ") + table + " ADD COLUMN " + column + " " + decl + ";";
+    return run_sql(db, q.c_str());
+}
+
+// =================== STEPS ===================
+
+// 1: the schema Database::init_schema used to create under DB_INIT=1.
+static bool m1_base_schema(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE TABLE IF NOT EXISTS users ("
+        "  username TEXT PRIMARY KEY,"
+        "  password TEXT NOT NULL,"
+        "  role TEXT NOT NULL DEFAULT 'user',"
+        "  approved INTEGER NOT NULL DEFAULT 0,"
+        "  sensor_count INTEGER NOT NULL DEFAULT 0"
+        ");"
+        "CREATE TABLE IF NOT EXISTS sensors ("
+        "  uuid TEXT PRIMARY KEY, "
+        "  user TEXT, "
+        "  commissioned INTEGER NOT NULL DEFAULT 0, "
+        "  config_time INTEGER DEFAULT 0, "
+        "  status TEXT, "
+        "  alert INTEGER NOT NULL DEFAULT 0, "
+        "  adv_interval INTEGER DEFAULT 5"
+        ");"
+        "CREATE TABLE IF NOT EXISTS sensor_readings ("
+        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  sensor_uuid TEXT NOT NULL,"
+        "  timestamp INTEGER NOT NULL,"
+        "  temperature REAL,"
+        "  vibration REAL,"
+        "  battery INTEGER"
+        ");"
+        "CREATE TABLE IF NOT EXISTS alerts ("
+        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  sensor_uuid TEXT NOT NULL,"
+        "  temperature REAL,"
+        "  vibration REAL,"
+        "  attempts INTEGER NOT NULL DEFAULT 0,"
+        "  processed INTEGER NOT NULL DEFAULT 0,"
+        "  done INTEGER NOT NULL DEFAULT 0,"
+        "  created_at INTEGER NOT NULL DEFAULT (strftime('%s','now'))"
+        ");");
+}
+
+// 2: databases created from the pre-v4 shared/init.sql lack these columns.
+static bool m2_backfill_legacy_columns(sqlite3* db)
+{
+    return add_column(db, "users", "sensor_count", "INTEGER NOT NULL DEFAULT 0")
+        && add_column(db, "sensors", "user", "TEXT")
+        && add_column(db, "sensors", "status", "TEXT")
+        && add_column(db, "sensors", "alert", "INTEGER NOT NULL DEFAULT 0")
+        && add_column(db, "sensors", "adv_interval", "INTEGER DEFAULT 5")
+        && run_sql(db,
+            "UPDATE sensors SET status = CASE WHEN commissioned=1 THEN 'commissioned' "
+            "ELSE 'uncommissioned' END WHERE status IS NULL;")
+        // ADD COLUMN can't take a strftime() default: stamp existing rows here,
+        // create_alert sets it explicitly from now on.
+        && (has_column(db, "alerts", "created_at") ||
+            (add_column(db, "alerts", "created_at", "INTEGER NOT NULL DEFAULT 0")
+             && run_sql(db, "UPDATE alerts SET created_at = strftime('%s','now') WHERE created_at = 0;")));
+}
+
+// 3: per-minute / per-hour reading rollups (Database::update_rollups).
+static bool m3_reading_rollups(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE TABLE IF NOT EXISTS reading_rollups ("
+        "  sensor_uuid TEXT NOT NULL,"
+        "  bucket_secs INTEGER NOT NULL,"
+        "  bucket_ts INTEGER NOT NULL,"
+        "  count INTEGER NOT NULL,"
+        "  temp_min REAL, temp_max REAL, temp_sum REAL,"
+        "  vib_min REAL, vib_max REAL, vib_sum REAL,"
+        "  batt_min INTEGER, batt_max INTEGER, batt_sum INTEGER,"
+        "  PRIMARY KEY (sensor_uuid, bucket_secs, bucket_ts)"
+        ") WITHOUT ROWID;");
+}
+
+// 4: one covering (and where possible partial) index per hot query, so each
+// is answered from the index alone (checked by Database::verify_query_plans).
+static bool m4_hot_query_indexes(sqlite3* db)
+{
+    return run_sql(db,
+        // get_readings / get_readings_range
+        "CREATE INDEX IF NOT EXISTS idx_readings_sensor_ts "
+        "  ON sensor_readings(sensor_uuid, timestamp, temperature, vibration, battery);"
+        // get_pending_alerts: only open alerts are indexed
+        "CREATE INDEX IF NOT EXISTS idx_alerts_pending "
+        "  ON alerts(id, sensor_uuid, temperature, vibration, attempts) WHERE done=0;"
+        // get_alerts (replaced in 12)
+        "CREATE INDEX IF NOT EXISTS idx_alerts_created "
+        "  ON alerts(created_at, id, sensor_uuid, temperature, vibration, attempts);"
+        // get_sensors_for_user(admin=false)
+        "CREATE INDEX IF NOT EXISTS idx_sensors_user "
+        "  ON sensors(user, uuid, commissioned, status, alert, adv_interval, config_time);");
+}
+
+// 5: lets retention find expired rollups without a full scan.
+static bool m5_rollup_retention_index(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE INDEX IF NOT EXISTS idx_rollups_bucket_ts ON reading_rollups(bucket_ts);");
+}
+
+// 6: the dispatcher times create -> delivery, so pending alerts carry
+// created_at; keep the partial index covering.
+static bool m6_pending_alerts_created_at(sqlite3* db)
+{
+    return run_sql(db,
+        "DROP INDEX IF EXISTS idx_alerts_pending;"
+        "CREATE INDEX idx_alerts_pending "
+        "  ON alerts(id, sensor_uuid, temperature, vibration, attempts, created_at) WHERE done=0;");
+}
+
+// 7: failed alerts wait out a backoff instead of going out on every poll.
+// The second index lets get_pending_alerts hold back a sensor's later
+// alerts while an earlier one is still waiting.
+static bool m7_alert_backoff(sqlite3* db)
+{
+    return add_column(db, "alerts", "next_attempt_at", "INTEGER NOT NULL DEFAULT 0")
+        && run_sql(db,
+            "DROP INDEX IF EXISTS idx_alerts_pending;"
+            "CREATE INDEX idx_alerts_pending "
+            "  ON alerts(id, sensor_uuid, temperature, vibration, attempts, created_at, next_attempt_at) "
+            "  WHERE done=0;"
+            "CREATE INDEX IF NOT EXISTS idx_alerts_pending_sensor "
+            "  ON alerts(sensor_uuid, id, next_attempt_at) WHERE done=0;");
+}
+
+// 8: alerts the worker gave up on, kept apart from delivered ones so they
+// can be inspected and replayed. id is the alert's (never reused).
+static bool m8_dead_letters(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE TABLE IF NOT EXISTS alert_dead_letters ("
+        "  id INTEGER PRIMARY KEY,"
+        "  sensor_uuid TEXT NOT NULL,"
+        "  temperature REAL,"
+        "  vibration REAL,"
+        "  attempts INTEGER NOT NULL DEFAULT 0,"
+        "  created_at INTEGER NOT NULL,"
+        "  failed_at INTEGER NOT NULL,"
+        "  reason TEXT NOT NULL,"
+        "  last_error TEXT"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_dead_letters_sensor ON alert_dead_letters(sensor_uuid, id);");
+}
+
+// 9: alert coalescing and idempotent delivery. Repeated breaches fold into
+// the sensor's latest alert (count, peaks, last_seen), found through
+// idx_alerts_sensor_created. idem_key travels with every delivery, and
+// dead letters keep it so that a replay stays the same alert to the
+// receiver. The gateway records the keys it has applied in alert_receipts.
+static bool m9_alert_coalescing(sqlite3* db)
+{
+    return add_column(db, "alerts", "count", "INTEGER NOT NULL DEFAULT 1")
+        && add_column(db, "alerts", "peak_temp", "REAL")
+        && add_column(db, "alerts", "peak_vib", "REAL")
+        && add_column(db, "alerts", "last_seen", "INTEGER")
+        && add_column(db, "alerts", "idem_key", "TEXT")
+        && add_column(db, "alert_dead_letters", "count", "INTEGER NOT NULL DEFAULT 1")
+        && add_column(db, "alert_dead_letters", "peak_temp", "REAL")
+        && add_column(db, "alert_dead_letters", "peak_vib", "REAL")
+        && add_column(db, "alert_dead_letters", "idem_key", "TEXT")
+        && run_sql(db,
+            "UPDATE alerts SET peak_temp = temperature, peak_vib = vibration, last_seen = created_at, "
+            "  idem_key = 'alert-' || id WHERE idem_key IS NULL;"
+            "UPDATE alert_dead_letters SET peak_temp = temperature, peak_vib = vibration, "
+            "  idem_key = 'alert-' || id WHERE idem_key IS NULL;"
+            "CREATE INDEX IF NOT EXISTS idx_alerts_sensor_created ON alerts(sensor_uuid, created_at);"
+            "CREATE TABLE IF NOT EXISTS alert_receipts ("
+            "  idem_key TEXT PRIMARY KEY,"
+            "  sensor_uuid TEXT NOT NULL,"
+            "  received_at INTEGER NOT NULL"
+            ") WITHOUT ROWID;"
+            "CREATE INDEX IF NOT EXISTS idx_alert_receipts_received ON alert_receipts(received_at);");
+}
+
+// 10: alert_worker instances claim alerts with a lease (claimed_by,
+// lease_until) so several can share the table; an expired lease makes the
+// alert claimable again. The pending indexes carry the lease so the claim
+// query stays index-only up to the row update.
+static bool m10_alert_leases(sqlite3* db)
+{
+    return add_column(db, "alerts", "claimed_by", "TEXT")
+        && add_column(db, "alerts", "lease_until", "INTEGER NOT NULL DEFAULT 0")
+        && run_sql(db,
+            "DROP INDEX IF EXISTS idx_alerts_pending;"
+            "CREATE INDEX idx_alerts_pending "
+            "  ON alerts(id, sensor_uuid, next_attempt_at, lease_until) WHERE done=0;"
+            "DROP INDEX IF EXISTS idx_alerts_pending_sensor;"
+            "CREATE INDEX idx_alerts_pending_sensor "
+            "  ON alerts(sensor_uuid, id, next_attempt_at, lease_until) WHERE done=0;");
+}
+
+// 11: alert rules per sensor, per user and a default, replacing the fixed
+// temperature > 80 or vibration > 9 check (kept as the seeded default).
+static bool m11_alert_rules(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE TABLE IF NOT EXISTS alert_rules ("
+        "  id INTEGER PRIMARY KEY,"
+        "  scope TEXT NOT NULL CHECK (scope IN ('default', 'user', 'sensor')),"
+        "  target TEXT NOT NULL DEFAULT '',"
+        "  temp_max REAL,"
+        "  vib_max REAL,"
+        "  batt_min INTEGER,"
+        "  match TEXT NOT NULL DEFAULT 'any' CHECK (match IN ('any', 'all')),"
+        "  temp_hyst REAL NOT NULL DEFAULT 0,"
+        "  vib_hyst REAL NOT NULL DEFAULT 0,"
+        "  batt_hyst INTEGER NOT NULL DEFAULT 0,"
+        "  enabled INTEGER NOT NULL DEFAULT 1,"
+        "  UNIQUE (scope, target)"
+        ");"
+        "INSERT OR IGNORE INTO alert_rules (scope, target, temp_max, vib_max) VALUES ('default', '', 80, 9);");
+}
+
+// Bumps table_versions for `table` on insert, delete and updates of `cols`.
+#define VERSION_TRIGGERS(table, cols) \
+    "CREATE TRIGGER IF NOT EXISTS " table "_version_ins AFTER INSERT ON " table " BEGIN" \
+    "  UPDATE table_versions SET version = version + 1 WHERE name = '" table "';" \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS " table "_version_upd AFTER UPDATE OF " cols " ON " table " BEGIN" \
+    "  UPDATE table_versions SET version = version + 1 WHERE name = '" table "';" \
+    "END;" \
+    "CREATE TRIGGER IF NOT EXISTS " table "_version_del AFTER DELETE ON " table " BEGIN" \
+    "  UPDATE table_versions SET version = version + 1 WHERE name = '" table "';" \
+    "END;"
+
+// 12: change counters behind the list routes' ETags (Database::table_version).
+// Only columns those routes show count, so alert delivery bookkeeping
+// (attempts, leases, coalesced breaches) and password changes do not.
+// /alerts now pages by id, which leaves the wide idx_alerts_created to
+// retention alone; a partial index of closed alerts serves that instead.
+static bool m12_table_versions(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE TABLE IF NOT EXISTS table_versions ("
+        "  name TEXT PRIMARY KEY,"
+        "  version INTEGER NOT NULL DEFAULT 1"
+        ") WITHOUT ROWID;"
+        "INSERT OR IGNORE INTO table_versions (name) VALUES ('alerts'), ('sensors'), ('users');"
+        VERSION_TRIGGERS("alerts", "sensor_uuid, temperature, vibration, created_at")
+        VERSION_TRIGGERS("sensors", "uuid, user, commissioned, status, alert, adv_interval, config_time")
+        VERSION_TRIGGERS("users", "username, role, approved")
+        "DROP INDEX IF EXISTS idx_alerts_created;"
+        "CREATE INDEX IF NOT EXISTS idx_alerts_closed ON alerts(created_at) WHERE done=1;");
+}
+
+// 13: the chunked readings engine's table (DB_READINGS_ENGINE=chunked),
+// previously created by the engine itself outside the migration history.
+static bool m13_reading_chunks(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE TABLE IF NOT EXISTS reading_chunks ("
+        "  id INTEGER PRIMARY KEY,"
+        "  sensor_uuid TEXT NOT NULL,"
+        "  min_ts INTEGER NOT NULL,"
+        "  max_ts INTEGER NOT NULL,"
+        "  count INTEGER NOT NULL,"
+        "  data BLOB NOT NULL"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_reading_chunks_sensor "
+        "  ON reading_chunks(sensor_uuid, max_ts);");
+}
+
+// 14: lets retention pick expired readings by timestamp rather than
+// walking the oldest rowids, which missed old samples stored late.
+static bool m14_readings_retention_index(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE INDEX IF NOT EXISTS idx_readings_ts ON sensor_readings(timestamp);");
+}
+
+// 15: the same for the chunked engine: expired chunks by their newest
+// sample, instead of the oldest ids, which long-lived sensors keep recent.
+static bool m15_chunk_retention_index(sqlite3* db)
+{
+    return run_sql(db,
+        "CREATE INDEX IF NOT EXISTS idx_reading_chunks_max_ts ON reading_chunks(max_ts);");
+}
+
+struct Migration {
+    int version;
+    const char* name;
+    bool (*apply)(sqlite3* db);
+};
+
+static const Migration MIGRATIONS[] = {
+    {1, "base schema", m1_base_schema},
+    {2, "backfill legacy init.sql columns", m2_backfill_legacy_columns},
+    {3, "reading rollups", m3_reading_rollups},
+    {4, "hot query indexes", m4_hot_query_indexes},
+    {5, "rollup retention index", m5_rollup_retention_index},
+    {6, "pending alerts carry created_at", m6_pending_alerts_created_at},
+    {7, "alert retry backoff", m7_alert_backoff},
+    {8, "alert dead letters", m8_dead_letters},
+    {9, "alert coalescing and idempotency keys", m9_alert_coalescing},
+    {10, "alert claim leases", m10_alert_leases},
+    {11, "alert rules", m11_alert_rules},
+    {12, "table change counters", m12_table_versions},
+    {13, "chunked readings table", m13_reading_chunks},
+    {14, "readings retention index", m14_readings_retention_index},
+    {15, "chunk retention index", m15_chunk_retention_index},
+};
+
+// =================== RUNNER ===================
+
+int schema_version(sqlite3* db)
+{
+    sqlite3_stmt* stmt = nullptr;
+    int v = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        v = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return v;
+}
+
+int latest_schema_version()
+{
+    return MIGRATIONS[sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0]) - 1].version;
+}
+
+bool run_migrations(sqlite3* db)
+{
+    int current = schema_version(db);
+    if (current > latest_schema_version()) {
+        Logger::instance().warn("DB schema v" + std::to_string(current) +
+                                " is newer than this build (v" + std::to_string(latest_schema_version()) + ")");
+        return true;
+    }
+
+    for (const auto& m : MIGRATIONS) {
+        if (m.version <= current)
+            continue;
+        if (!m.apply(db)) {
+            Logger::instance().error("Migration " + std::to_string(m.version) + " (" + m.name + ") failed");
+            return false;
+        }
+        std::string q = "PRAGMA user_version=" + std::to_string(m.version) + ";";
+        if (!run_sql(db, q.c_str()))
+            return false;
+        Logger::instance().info("Applied migration " + std::to_string(m.version) + ": " + m.name);
+    }
+    return true;
+}
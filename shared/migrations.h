@@ -0,0 +1,12 @@
+#pragma once
+#include <sqlite3.h>
+
+// Versioned schema upgrades. PRAGMA user_version holds the last applied
+// step; run_migrations applies the newer ones in order. The caller must
+// hold the writer inside a BEGIN IMMEDIATE transaction so concurrent
+// service startups migrate exactly once.
+//
+// Never edit a step that has shipped - append a new one.
+int schema_version(sqlite3* db);
+int latest_schema_version();
+bool run_migrations(sqlite3* db);
@@ -1,5 +1,9 @@
 #pragma once
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 // Existing structs you already had:
 struct UserRow {
@@ -15,15 +19,106 @@ struct ReadingRow {
     int ts;
 };
 
+// One incoming sample for Database::insert_readings (ts <= 0 means "now").
+struct ReadingSample {
+    std::string sensor_uuid;
+    double temp;
+    double vib;
+    int batt;
+    int ts;
+};
+
+// One time bucket of pre-aggregated readings (see Database::get_rollups).
+struct RollupRow {
+    int bucket_ts;              // bucket start, unix seconds
+    int count;
+    double temp_min, temp_max, temp_avg;
+    double vib_min, vib_max, vib_avg;
+    int batt_min, batt_max;
+    double batt_avg;
+};
+
 struct AlertRow {
     int id;
     std::string sensor_uuid;
+    double temperature;         // first breach of the alert
+    double vibration;
+    int attempts;
+    int created_at;
+    // Set by get_pending_alerts (see Database::raise_alert).
+    int count = 1;              // breaches folded into this alert
+    double peak_temp = 0;
+    double peak_vib = 0;
+    std::string idem_key;
+};
+
+// An alerts row as Database::scan_alerts sees it on the cursor; the
+// strings point into SQLite's row buffer and only live for the callback.
+struct AlertView {
+    int id;
+    std::string_view sensor_uuid;
     double temperature;
     double vibration;
     int attempts;
     int created_at;
 };
 
+// Outcome of one delivery round (Database::apply_alert_results).
+struct AlertResults {
+    std::vector<int> delivered;                 // acknowledged: processed and closed
+    std::vector<std::pair<int, int>> retry;     // failed: id, next_attempt_at
+    std::vector<int> dead;                      // failed for the last time
+    std::string reason;                         // why `dead` are given up on
+    std::string last_error;                     // the failure, for every failed id
+};
+
+// One alert as received by the gateway (POST /alert_notify[/batch]).
+struct AlertNotice {
+    std::string idem_key;       // empty: sent by a worker without keys
+    std::string sensor_uuid;
+};
+
+// An alert the worker gave up on (see Database::dead_letter_alert).
+struct DeadLetterRow {
+    int id;                     // the original alert's id
+    std::string sensor_uuid;
+    double temperature;
+    double vibration;
+    int attempts;
+    int created_at;
+    int failed_at;
+    std::string reason;
+    std::string last_error;
+    int count;
+    double peak_temp;
+    double peak_vib;
+    std::string idem_key;
+};
+
+// Which dead letters to list or replay: one sensor or all, by the alert's
+// created_at, and ids after `after_id` (paging).
+struct DeadLetterFilter {
+    std::string sensor_uuid;    // empty = all sensors
+    int from = 0;
+    int to = 2147483647;
+    int after_id = 0;
+};
+
+// One row of alert_rules, see AlertRules. Unset thresholds take no part.
+struct AlertRuleRow {
+    int id = 0;
+    std::string scope = "default";      // "default", "user" or "sensor"
+    std::string target;                 // username / sensor uuid, "" for default
+    std::optional<double> temp_max;     // fires above
+    std::optional<double> vib_max;      // fires above
+    std::optional<int> batt_min;        // fires below
+    bool match_all = false;             // all set conditions, or any of them
+    double temp_hyst = 0;               // how far back past the threshold a
+    double vib_hyst = 0;                // reading must go to clear the alarm
+    int batt_hyst = 0;
+    bool enabled = true;
+};
+
 // NEW: for listing sensors in UI
 struct SensorRow {
     std::string uuid;
@@ -34,3 +129,14 @@ struct SensorRow {
     int adv_interval;          // seconds
     int config_time;           // seconds (user set)
 };
+
+// A sensors row as Database::scan_sensors_for_user sees it (see AlertView).
+struct SensorView {
+    std::string_view uuid;
+    std::string_view user;
+    bool commissioned;
+    std::string_view status;
+    bool alert;
+    int adv_interval;
+    int config_time;
+};
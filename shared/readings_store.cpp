@@ -0,0 +1,351 @@
+#include "readings_store.h"
+#include "log.h"
+#include <algorithm>
+#include <climits>
+
+std::unique_ptr<ReadingsStore> make_readings_store(const std::string& engine)
+{
+    if (engine == "chunked")
+        return std::make_unique<ChunkedReadingsStore>();
+    if (!engine.empty() && engine != "sqlite")
+        Logger::instance().warn("Unknown readings engine '" + engine + "', using sqlite");
+    return std::make_unique<SqliteReadingsStore>();
+}
+
+static void log_sql_err(const StoreConn& c, const char* what)
+{
+    Logger::instance().error(std::string("SQL ERR on exec for ") + what + ": " + sqlite3_errmsg(c.db));
+}
+
+// =================== SQLITE (row per sample) ===================
+
+// Rows per multi-row INSERT: 5 params each keeps us well below the
+// 999-variable limit of older SQLite builds.
+static const size_t READINGS_PER_STMT = 64;
+
+static std::string multi_row_reading_insert(size_t rows)
+{
+    std::string q =
+        "INSERT INTO sensor_readings("
+        "sensor_uuid,timestamp,temperature,vibration,battery"
+        ") VALUES ";
+    for (size_t i = 0; i < rows; ++i) {
+        q += (i == 0) ? "(?,?,?,?,?)" : ",(?,?,?,?,?)";
+    }
+    q += ";";
+    return q;
+}
+
+static void bind_reading(sqlite3_stmt* stmt, int base, const ReadingSample& r)
+{
+    sqlite3_bind_text(stmt, base + 1, r.sensor_uuid.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, base + 2, r.ts);
+    sqlite3_bind_double(stmt, base + 3, r.temp);
+    sqlite3_bind_double(stmt, base + 4, r.vib);
+    sqlite3_bind_int(stmt, base + 5, r.batt);
+}
+
+const char* const SqliteReadingsStore::RANGE_SQL =
+    "SELECT temperature,vibration,battery,timestamp "
+    "FROM sensor_readings WHERE sensor_uuid=? AND timestamp BETWEEN ? AND ? "
+    "ORDER BY timestamp DESC LIMIT ?;";
+
+bool SqliteReadingsStore::append(const StoreConn& c, const std::vector<ReadingSample>& batch)
+{
+    static const std::string batch_q = multi_row_reading_insert(READINGS_PER_STMT);
+    const char* single_q =
+        "INSERT INTO sensor_readings("
+        "sensor_uuid,timestamp,temperature,vibration,battery"
+        ") VALUES (?,?,?,?,?);";
+
+    size_t i = 0;
+
+    if (batch.size() >= READINGS_PER_STMT) {
+        auto stmt = c.stmts->acquire(batch_q.c_str());
+        if (!stmt) {
+            log_sql_err(c, "insert_readings");
+            return false;
+        }
+        for (; i + READINGS_PER_STMT <= batch.size(); i += READINGS_PER_STMT) {
+            for (size_t k = 0; k < READINGS_PER_STMT; ++k) {
+                bind_reading(stmt, static_cast<int>(k * 5), batch[i + k]);
+            }
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                log_sql_err(c, "insert_readings");
+                return false;
+            }
+            sqlite3_reset(stmt);
+        }
+    }
+
+    if (i < batch.size()) {
+        auto stmt = c.stmts->acquire(single_q);
+        if (!stmt) {
+            log_sql_err(c, "insert_readings");
+            return false;
+        }
+        for (; i < batch.size(); ++i) {
+            bind_reading(stmt, 0, batch[i]);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                log_sql_err(c, "insert_readings");
+                return false;
+            }
+            sqlite3_reset(stmt);
+        }
+    }
+    return true;
+}
+
+bool SqliteReadingsStore::query(const StoreConn& c, const std::string& uuid, int from, int to, int max,
+                                std::vector<ReadingRow>& out)
+{
+    auto stmt = c.stmts->acquire(RANGE_SQL);
+    if (!stmt)
+        return false;
+
+    sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, from);
+    sqlite3_bind_int(stmt, 3, to);
+    sqlite3_bind_int(stmt, 4, max);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        ReadingRow r;
+        r.temp = sqlite3_column_double(stmt, 0);
+        r.vib  = sqlite3_column_double(stmt, 1);
+        r.batt = sqlite3_column_int(stmt, 2);
+        r.ts   = sqlite3_column_int(stmt, 3);
+        out.push_back(r);
+    }
+    return true;
+}
+
+const char* const SqliteReadingsStore::PURGE_SQL =
+    "DELETE FROM sensor_readings WHERE rowid IN "
+    "(SELECT rowid FROM sensor_readings WHERE timestamp < ?1 "
+    " ORDER BY timestamp LIMIT ?2);";
+
+int SqliteReadingsStore::purge(const StoreConn& c, int cutoff_ts, int max_rows)
+{
+    auto stmt = c.stmts->acquire(PURGE_SQL);
+    if (!stmt) {
+        log_sql_err(c, "purge_readings");
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, cutoff_ts);
+    sqlite3_bind_int(stmt, 2, max_rows);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        log_sql_err(c, "purge_readings");
+        return -1;
+    }
+    return sqlite3_changes(c.db);
+}
+
+// =================== CHUNKED (Gorilla columns) ===================
+
+ChunkedReadingsStore::OpenChunk* ChunkedReadingsStore::open_chunk(const StoreConn& c, const std::string& uuid)
+{
+    auto it = open_.find(uuid);
+    if (it != open_.end())
+        return &it->second;
+
+    OpenChunk oc;
+
+    // Resume the sensor's newest chunk if it still has room.
+    const char* q =
+        "SELECT id,count,data FROM reading_chunks "
+        "WHERE sensor_uuid=? ORDER BY id DESC LIMIT 1;";
+    auto stmt = c.stmts->acquire(q);
+    if (!stmt)
+        return nullptr;
+
+    sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW &&
+        static_cast<size_t>(sqlite3_column_int(stmt, 1)) < ReadingChunk::MAX_ROWS)
+    {
+        auto data = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 2));
+        size_t n = static_cast<size_t>(sqlite3_column_bytes(stmt, 2));
+        if (ReadingChunk::load(data, n, oc.chunk))
+            oc.id = sqlite3_column_int64(stmt, 0);
+    }
+
+    return &open_.emplace(uuid, std::move(oc)).first->second;
+}
+
+bool ChunkedReadingsStore::store(const StoreConn& c, const std::string& uuid, OpenChunk& oc)
+{
+    std::vector<uint8_t> blob = oc.chunk.serialize();
+
+    const char* q = oc.id == 0
+        ? "INSERT INTO reading_chunks(min_ts,max_ts,count,data,sensor_uuid) VALUES (?,?,?,?,?);"
+        : "UPDATE reading_chunks SET min_ts=?,max_ts=?,count=?,data=? WHERE id=?;";
+    auto stmt = c.stmts->acquire(q);
+    if (!stmt)
+        return false;
+
+    sqlite3_bind_int(stmt, 1, oc.chunk.min_ts());
+    sqlite3_bind_int(stmt, 2, oc.chunk.max_ts());
+    sqlite3_bind_int(stmt, 3, static_cast<int>(oc.chunk.count()));
+    sqlite3_bind_blob(stmt, 4, blob.data(), static_cast<int>(blob.size()), SQLITE_STATIC);
+    if (oc.id == 0)
+        sqlite3_bind_text(stmt, 5, uuid.c_str(), -1, SQLITE_STATIC);
+    else
+        sqlite3_bind_int64(stmt, 5, oc.id);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+        return false;
+    if (oc.id == 0)
+        oc.id = sqlite3_last_insert_rowid(c.db);
+    return true;
+}
+
+bool ChunkedReadingsStore::append(const StoreConn& c, const std::vector<ReadingSample>& batch)
+{
+    // Each touched chunk is written once per batch, not once per sample.
+    std::vector<const std::string*> dirty;
+
+    for (const auto& s : batch) {
+        OpenChunk* oc = open_chunk(c, s.sensor_uuid);
+        if (!oc) {
+            log_sql_err(c, "insert_readings");
+            return false;
+        }
+        if (!oc->dirty) {
+            oc->dirty = true;
+            dirty.push_back(&s.sensor_uuid);
+        }
+
+        oc->chunk.append(ReadingRow{s.temp, s.vib, s.batt, s.ts});
+        if (oc->chunk.full()) {
+            // Sealed: persist it now and start a fresh chunk next time.
+            if (!store(c, s.sensor_uuid, *oc)) {
+                log_sql_err(c, "insert_readings");
+                return false;
+            }
+            open_.erase(s.sensor_uuid);
+        }
+    }
+
+    for (const std::string* uuid : dirty) {
+        auto it = open_.find(*uuid);
+        if (it == open_.end() || !it->second.dirty)
+            continue;
+        it->second.dirty = false;
+        if (!store(c, *uuid, it->second)) {
+            log_sql_err(c, "insert_readings");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ChunkedReadingsStore::query(const StoreConn& c, const std::string& uuid, int from, int to, int max,
+                                 std::vector<ReadingRow>& out)
+{
+    if (max == 0)
+        return true;
+    const size_t limit = max < 0 ? SIZE_MAX : static_cast<size_t>(max);
+
+    const char* q =
+        "SELECT max_ts,data FROM reading_chunks "
+        "WHERE sensor_uuid=? AND max_ts>=? AND min_ts<=? "
+        "ORDER BY max_ts DESC, id DESC;";
+    auto stmt = c.stmts->acquire(q);
+    if (!stmt)
+        return false;
+
+    sqlite3_bind_text(stmt, 1, uuid.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, from);
+    sqlite3_bind_int(stmt, 3, to);
+
+    auto newer = [](const ReadingRow& a, const ReadingRow& b) { return a.ts > b.ts; };
+    std::vector<ReadingRow> rows;
+    std::vector<ReadingRow> hits;
+    int threshold = INT_MIN;   // ts of the limit-th newest row so far
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        // Chunks come newest first; once we hold `limit` rows, an older
+        // chunk can no longer contribute.
+        if (hits.size() >= limit && sqlite3_column_int(stmt, 0) < threshold)
+            break;
+
+        rows.clear();
+        auto data = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 1));
+        size_t n = static_cast<size_t>(sqlite3_column_bytes(stmt, 1));
+        if (!ReadingChunk::decode(data, n, rows))
+            continue;
+
+        // Newest appended first, matching ORDER BY timestamp DESC on ties.
+        for (auto r = rows.rbegin(); r != rows.rend(); ++r) {
+            if (r->ts >= from && r->ts <= to)
+                hits.push_back(*r);
+        }
+        if (hits.size() >= limit) {
+            std::stable_sort(hits.begin(), hits.end(), newer);
+            hits.resize(limit);
+            threshold = hits.back().ts;
+        }
+    }
+
+    std::stable_sort(hits.begin(), hits.end(), newer);
+    if (hits.size() > limit)
+        hits.resize(limit);
+    out.insert(out.end(), hits.begin(), hits.end());
+    return true;
+}
+
+const char* const ChunkedReadingsStore::PURGE_SQL =
+    "SELECT id,sensor_uuid,count FROM reading_chunks WHERE max_ts < ?1 "
+    "ORDER BY max_ts LIMIT ?2;";
+
+int ChunkedReadingsStore::purge(const StoreConn& c, int cutoff_ts, int max_rows)
+{
+    const char* del = "DELETE FROM reading_chunks WHERE id=?;";
+
+    struct Victim { sqlite3_int64 id; std::string uuid; int count; };
+    std::vector<Victim> victims;
+    {
+        auto stmt = c.stmts->acquire(PURGE_SQL);
+        if (!stmt) {
+            log_sql_err(c, "purge_readings");
+            return -1;
+        }
+        sqlite3_bind_int(stmt, 1, cutoff_ts);
+        // Every chunk holds at least one sample, so max_rows chunks is
+        // always enough; the budget is counted in samples.
+        sqlite3_bind_int(stmt, 2, max_rows);
+        int budget = max_rows;
+        while (budget > 0 && sqlite3_step(stmt) == SQLITE_ROW) {
+            victims.push_back({sqlite3_column_int64(stmt, 0),
+                               reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)),
+                               sqlite3_column_int(stmt, 2)});
+            budget -= victims.back().count;
+        }
+    }
+
+    auto stmt = c.stmts->acquire(del);
+    if (!stmt) {
+        log_sql_err(c, "purge_readings");
+        return -1;
+    }
+
+    int samples = 0;
+    for (const auto& v : victims) {
+        sqlite3_bind_int64(stmt, 1, v.id);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            log_sql_err(c, "purge_readings");
+            return -1;
+        }
+        sqlite3_reset(stmt);
+        samples += v.count;
+
+        // A quiet sensor's open chunk can expire too; its next sample
+        // must start a new row instead of updating the deleted one.
+        auto it = open_.find(v.uuid);
+        if (it != open_.end() && it->second.id == v.id)
+            open_.erase(it);
+    }
+    return samples;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+#include "models.h"
+#include "stmt_cache.h"
+#include "chunk_codec.h"
+
+// The connection a storage engine runs on, leased by Database.
+struct StoreConn {
+    sqlite3* db;
+    StatementCache* stmts;
+};
+
+// Storage engine behind Database's readings API (insert_readings,
+// get_readings, get_readings_range). Selected with DB_READINGS_ENGINE.
+// Every engine's tables come from the migrations (shared/migrations.cpp).
+class ReadingsStore {
+public:
+    virtual ~ReadingsStore() = default;
+    virtual const char* name() const = 0;
+
+    // Called on the writer inside a transaction.
+    virtual bool append(const StoreConn& c, const std::vector<ReadingSample>& batch) = 0;
+
+    // Newest first, at most `max` rows with from <= ts <= to.
+    virtual bool query(const StoreConn& c, const std::string& uuid, int from, int to, int max,
+                       std::vector<ReadingRow>& out) = 0;
+
+    // Deletes up to `max_rows` samples older than cutoff_ts, oldest first
+    // (writer, inside a transaction). Returns samples removed, -1 on error.
+    virtual int purge(const StoreConn& c, int cutoff_ts, int max_rows) = 0;
+
+    // The enclosing transaction rolled back: forget state built from it.
+    virtual void discard_uncommitted() {}
+};
+
+// "sqlite" (default): one sensor_readings row per sample.
+// "chunked": Gorilla-encoded per-sensor column chunks in reading_chunks.
+std::unique_ptr<ReadingsStore> make_readings_store(const std::string& engine);
+
+class SqliteReadingsStore : public ReadingsStore {
+public:
+    // Newest-first range scan; served by idx_readings_sensor_ts.
+    static const char* const RANGE_SQL;
+    // Oldest expired rows by timestamp, so backfilled samples stored late
+    // are found too; served by idx_readings_ts.
+    static const char* const PURGE_SQL;
+
+    const char* name() const override { return "sqlite"; }
+    bool append(const StoreConn& c, const std::vector<ReadingSample>& batch) override;
+    bool query(const StoreConn& c, const std::string& uuid, int from, int to, int max,
+               std::vector<ReadingRow>& out) override;
+    int purge(const StoreConn& c, int cutoff_ts, int max_rows) override;
+};
+
+class ChunkedReadingsStore : public ReadingsStore {
+public:
+    const char* name() const override { return "chunked"; }
+    bool append(const StoreConn& c, const std::vector<ReadingSample>& batch) override;
+    bool query(const StoreConn& c, const std::string& uuid, int from, int to, int max,
+               std::vector<ReadingRow>& out) override;
+    // Only whole chunks go: a chunk is removed once its newest sample
+    // expires, oldest first, until max_rows samples are gone (the last chunk
+    // may take it past). Served by idx_reading_chunks_max_ts.
+    static const char* const PURGE_SQL;
+    int purge(const StoreConn& c, int cutoff_ts, int max_rows) override;
+    void discard_uncommitted() override { open_.clear(); }
+
+private:
+    // The newest, not yet full chunk of a sensor; rewritten in place on
+    // every append so the table always holds every committed sample.
+    struct OpenChunk {
+        sqlite3_int64 id = 0;   // 0 = not stored yet
+        ReadingChunk chunk;
+        bool dirty = false;     // appended to in the current batch
+    };
+
+    OpenChunk* open_chunk(const StoreConn& c, const std::string& uuid);
+    bool store(const StoreConn& c, const std::string& uuid, OpenChunk& oc);
+
+    // Only touched with the Database writer held.
+    std::unordered_map<std::string, OpenChunk> open_;
+};
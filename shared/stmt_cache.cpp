@@ -0,0 +1,88 @@
+#include "stmt_cache.h"
+
+StatementCache::~StatementCache()
+{
+    clear();
+}
+
+StatementCache::Handle& StatementCache::Handle::operator=(Handle&& o) noexcept
+{
+    if (this != &o)
+    {
+        release();
+        cache_ = o.cache_;
+        slot_  = o.slot_;
+        stmt_  = o.stmt_;
+        o.stmt_ = nullptr;
+    }
+    return *this;
+}
+
+void StatementCache::Handle::release()
+{
+    if (!stmt_)
+        return;
+
+    // Reset before handing back so no read transaction stays open and
+    // the next caller starts from clean bindings.
+    sqlite3_reset(stmt_);
+    sqlite3_clear_bindings(stmt_);
+    cache_->give_back(slot_, stmt_);
+    stmt_ = nullptr;
+}
+
+StatementCache::Handle StatementCache::acquire(const char* sql)
+{
+    if (!db_)
+        return Handle();
+
+    Slot* slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = slots_.find(std::string_view(sql));
+        if (it == slots_.end())
+        {
+            auto fresh = std::make_unique<Slot>();
+            fresh->sql = sql;
+            std::string_view key(fresh->sql);
+            it = slots_.emplace(key, std::move(fresh)).first;
+        }
+        slot = it->second.get();
+
+        if (!slot->idle.empty())
+        {
+            sqlite3_stmt* stmt = slot->idle.back();
+            slot->idle.pop_back();
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return Handle(this, slot, stmt);
+        }
+    }
+
+    // Miss: prepare outside the lock, the statement joins the cache on release.
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v3(db_, slot->sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT,
+                           &stmt, nullptr) != SQLITE_OK)
+    {
+        sqlite3_finalize(stmt);
+        return Handle();
+    }
+    return Handle(this, slot, stmt);
+}
+
+void StatementCache::give_back(Slot* slot, sqlite3_stmt* stmt)
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    slot->idle.push_back(stmt);
+}
+
+void StatementCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& kv : slots_)
+    {
+        for (sqlite3_stmt* stmt : kv.second->idle)
+            sqlite3_finalize(stmt);
+        kv.second->idle.clear();
+    }
+}
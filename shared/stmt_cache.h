@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+
+// Prepared statements for one sqlite3 connection, keyed by SQL text.
+// acquire() checks an idle statement out of the cache (or prepares a new
+// one on a miss); the returned Handle resets it and hands it back when it
+// goes out of scope, so concurrent callers never share a statement.
+class StatementCache
+{
+    struct Slot
+    {
+        std::string sql;
+        std::vector<sqlite3_stmt*> idle;
+    };
+
+public:
+    class Handle
+    {
+    public:
+        Handle() = default;
+        Handle(StatementCache* cache, Slot* slot, sqlite3_stmt* stmt)
+            : cache_(cache), slot_(slot), stmt_(stmt) {}
+        ~Handle() { release(); }
+
+        Handle(Handle&& o) noexcept : cache_(o.cache_), slot_(o.slot_), stmt_(o.stmt_)
+        {
+            o.stmt_ = nullptr;
+        }
+        Handle& operator=(Handle&& o) noexcept;
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        sqlite3_stmt* get() const { return stmt_; }
+        operator sqlite3_stmt*() const { return stmt_; }
+        explicit operator bool() const { return stmt_ != nullptr; }
+
+    private:
+        void release();
+
+        StatementCache* cache_ = nullptr;
+        Slot* slot_ = nullptr;
+        sqlite3_stmt* stmt_ = nullptr;
+    };
+
+    explicit StatementCache(sqlite3* db) : db_(db) {}
+    ~StatementCache();
+
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    // Returns an empty handle if the statement cannot be prepared;
+    // sqlite3_errmsg() on the connection has the reason.
+    Handle acquire(const char* sql);
+
+    // Finalizes every idle statement (call before closing the connection).
+    void clear();
+
+    uint64_t hits() const   { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    void give_back(Slot* slot, sqlite3_stmt* stmt);
+
+    sqlite3* db_;
+    std::mutex mtx_;
+    // Keys view into Slot::sql, so lookups by const char* never allocate.
+    std::unordered_map<std::string_view, std::unique_ptr<Slot>> slots_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};